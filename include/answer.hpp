@@ -0,0 +1,119 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "image.hpp"
+#include "types.hpp"
+#include "exception.hpp"
+#include "dwrite.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 1回の選択操作を表す型です。
+選択する断片の位置(行, 列)と、その後に続く交換操作の列('U', 'D', 'L', 'R')を保持します。
+*/
+struct Operation
+{
+    Index2D select;         // 選択する位置 (行, 列)
+    std::string moves;      // 交換操作の列
+
+
+    void to_string(std::ostream& s) const
+    {
+        s << "(" << select[0] << ", " << select[1] << ") " << moves;
+    }
+};
+
+
+/** 回答全体を表す型です。
+先頭から順番に選択操作を適用します。
+*/
+typedef std::vector<Operation> Answer;
+
+
+/** 選択中の位置`idx`を方向`c`('U', 'D', 'L', 'R')に一つ動かします。
+盤面の外に出る場合や不正な文字の場合には、`idx`を変更せずにfalseを返します。
+*/
+inline bool moveIndex(Index2D& idx, char c, std::size_t div_x, std::size_t div_y)
+{
+    if(!isDirectionChar(c))
+        return false;
+
+    const auto next = Position(idx).moved(toDirection(c));
+    if(!next.inside(div_x, div_y))
+        return false;
+
+    idx = next.get_index();
+    return true;
+}
+
+
+/// 交換操作`c`の逆操作を返します
+inline char inverseMove(char c)
+{
+    return isDirectionChar(c) ? toChar(opposite(toDirection(c))) : c;
+}
+
+
+/** 回答のコスト(選択回数 * 選択レート + 交換回数 * 交換レート)を返します
+*/
+inline std::size_t answerCost(Answer const & ans, int select_cost, int change_cost)
+{
+    std::size_t moves = 0;
+    for(auto& op: ans)
+        moves += op.moves.size();
+
+    return ans.size() * select_cost + moves * change_cost;
+}
+
+
+/** 回答を`simulator.cpp`の入力形式で読み込みます。
+形式は、選択回数、続いて各選択について「16進数で xy の順番の位置」「交換回数」「交換操作の列」です。
+位置は1桁ずつ("xy")でも2桁ずつ("xxyy")でも読み込めます(`decodeAnswerPosition`)。
+*/
+inline Answer readAnswer(std::istream& is)
+{
+    Answer dst;
+
+    std::size_t selectCNT;
+    PROCON_ENFORCE(is >> std::dec >> selectCNT, "cannot read the number of selections");
+    dst.reserve(selectCNT);
+
+    for(std::size_t i = 0; i < selectCNT; ++i){
+        std::string pos;
+        std::size_t moveCNT;
+        PROCON_ENFORCE(is >> pos, "cannot read the selected position");
+        PROCON_ENFORCE(is >> std::dec >> moveCNT, "cannot read the number of changes");
+
+        Operation op;
+        op.select = decodeAnswerPosition(pos).get_index();
+
+        // 交換回数が0回のときは交換操作の行が空になる
+        if(moveCNT != 0)
+            PROCON_ENFORCE(is >> op.moves, "cannot read changes");
+
+        PROCON_ENFORCE(op.moves.size() == moveCNT, format("the number of changes mismatch: % != %", op.moves.size(), moveCNT));
+        dst.emplace_back(std::move(op));
+    }
+
+    return dst;
+}
+
+
+/** 回答を`simulator.cpp`の入力形式で書き出します。
+位置は`encodeAnswerPosition`で書き出すので、16×16以下の問題では従来と同じ出力になります。
+*/
+inline void writeAnswer(std::ostream& os, Answer const & ans)
+{
+    os << std::dec << ans.size() << '\n';
+    for(auto& op: ans){
+        os << encodeAnswerPosition(Position(op.select)) << '\n'
+           << op.moves.size() << '\n'
+           << op.moves << '\n';
+    }
+}
+
+}} // namespace procon::utils
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/optional.hpp>
+#include "image.hpp"
+#include "types.hpp"
+#include "answer.hpp"
+#include "replay.hpp"
+#include "thread_pool.hpp"
+#include "exception.hpp"
+#include "dwrite.hpp"
+
+
+namespace procon { namespace utils {
+
+/// 最終配置で異なる位置と、そこにある二つの断片です
+struct TileDifference
+{
+    Position pos;
+    ImageID a;
+    ImageID b;
+
+
+    void to_string(std::ostream& s) const
+    {
+        swrite(s, pos, ": ", a, " != ", b);
+    }
+};
+
+
+/** 二つの回答を同じ手数ずつ再生して比較した結果です。
+手数は`Replay`と同じく、選択操作も1手と数えます。先に終わった回答は、最終状態のまま比較を続けます。
+*/
+struct AnswerDiff
+{
+    boost::optional<std::size_t> firstDivergence;   // 断片の配置が最初に異なる手数。最後まで同じならnone
+    std::vector<std::size_t> costA;                 // costA[n]は回答Aのn手目までのコスト (長さは手数+1)
+    std::vector<std::size_t> costB;                 // ditto
+    std::vector<TileDifference> finalDifferences;   // 最終配置で異なる位置 (行優先)
+
+
+    std::size_t stepsA() const { return costA.size() - 1; }
+    std::size_t stepsB() const { return costB.size() - 1; }
+
+
+    /// 両方の回答の最終配置が同じかどうか
+    bool sameResult() const { return finalDifferences.empty(); }
+
+
+    /// 手数nまでのコストを比較します。Aの方が安ければ負、Bの方が安ければ正、等しければ0を返します。
+    int compareCostAt(std::size_t n) const
+    {
+        const auto a = costA[std::min(n, stepsA())],
+                   b = costB[std::min(n, stepsB())];
+
+        return a < b ? -1 : (a == b ? 0 : 1);
+    }
+
+
+    void to_string(std::ostream& s) const
+    {
+        s << "steps " << stepsA() << " / " << stepsB()
+          << ", cost " << costA.back() << " / " << costB.back();
+
+        if(firstDivergence)
+            s << ", diverge at " << *firstDivergence;
+        else
+            s << ", identical";
+
+        s << ", " << finalDifferences.size() << " tiles differ";
+    }
+};
+
+
+/** 二つの回答を同時に再生し、途中の配置が最初に異なる手数、各手数までのコスト、最終配置の違いを求めます。
+配置の違いは交換のたびに差分で更新するので、1手あたりの計算量は盤面の大きさによりません。
+盤面の外に出る交換操作を含む場合は例外を投げます。
+*/
+inline AnswerDiff diffAnswers(std::size_t div_x, std::size_t div_y, Answer const & a, Answer const & b,
+                              int select_cost, int change_cost)
+{
+    const auto stepsA = toReplaySteps(a, div_x, div_y),
+               stepsB = toReplaySteps(b, div_x, div_y);
+
+    ReplayState sa{Arrangement(div_x, div_y), boost::none, 0},
+                sb{Arrangement(div_x, div_y), boost::none, 0};
+
+    AnswerDiff dst;
+    dst.costA.reserve(stepsA.size() + 1);
+    dst.costB.reserve(stepsB.size() + 1);
+    dst.costA.push_back(0);
+    dst.costB.push_back(0);
+
+    std::size_t mismatch = 0;      // 配置が異なる位置の数
+
+    // 位置pの一致・不一致を数えなおすために、交換の前後で呼ぶ
+    auto account = [&](Position p, int sign){
+        if(sa.arrangement[p] != sb.arrangement[p])
+            mismatch += sign;
+    };
+
+    auto step = [&](ReplayState& s, std::vector<ReplayStep> const & steps, std::size_t n, std::vector<std::size_t>& cost){
+        if(n >= steps.size())
+            return;
+
+        const auto& st = steps[n];
+        const bool swaps = !st.isSelect && s.selected;
+        const Position p = s.selected ? *s.selected : Position(),
+                       q = p.moved(st.dir);
+
+        if(swaps && q.inside(div_x, div_y)){
+            account(p, -1);
+            account(q, -1);
+        }
+
+        applyReplayStep(s, st, div_x, div_y, select_cost, change_cost).onFailure([&](ErrorInfo const & e){
+            PROCON_ENFORCE(false, format("step %: %", n, e.msg));
+        });
+
+        if(swaps){
+            account(p, +1);
+            account(q, +1);
+        }
+
+        cost.push_back(s.cost);
+    };
+
+    const std::size_t total = std::max(stepsA.size(), stepsB.size());
+    for(std::size_t n = 0; n < total; ++n){
+        step(sa, stepsA, n, dst.costA);
+        step(sb, stepsB, n, dst.costB);
+
+        if(mismatch != 0 && !dst.firstDivergence)
+            dst.firstDivergence = n + 1;
+    }
+
+    for(auto i: iota(div_y))
+        for(auto j: iota(div_x)){
+            const Position p(i, j);
+            if(sa.arrangement[p] != sb.arrangement[p])
+                dst.finalDifferences.push_back(TileDifference{p, sa.arrangement[p], sb.arrangement[p]});
+        }
+
+    return dst;
+}
+
+
+/// ditto
+inline AnswerDiff diffAnswers(Problem const & pb, Answer const & a, Answer const & b)
+{
+    return diffAnswers(pb.div_x(), pb.div_y(), a, b, pb.select_cost(), pb.change_cost());
+}
+
+
+/** 多数の回答の組を、既定のスレッドプールで並列に比較します。結果は`pairs`と同じ順に並びます。
+いずれかの比較が例外を投げた場合は、処理中の比較が全て終わってから最初の例外を投げなおします。
+*/
+inline std::vector<AnswerDiff> diffAnswers(Problem const & pb, std::vector<std::pair<Answer, Answer>> const & pairs,
+                                           std::size_t nThreads = std::thread::hardware_concurrency())
+{
+    std::vector<AnswerDiff> dst(pairs.size());
+    defaultThreadPool().parallel_for(iota(pairs.size()), [&](std::size_t k){
+        dst[k] = diffAnswers(pb, pairs[k].first, pairs[k].second);
+    }, std::max<std::size_t>(nThreads, 1));
+
+    return dst;
+}
+
+}} // namespace procon::utils
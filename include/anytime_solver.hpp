@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <boost/optional.hpp>
+#include "image.hpp"
+#include "types.hpp"
+#include "answer.hpp"
+#include "arrangement.hpp"
+#include "replay.hpp"
+#include "move_optimizer.hpp"
+#include "exception.hpp"
+#include "dwrite.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 恒等配置から`target`の配置にする回答を、断片を1つずつ目的の位置へ運んで作ります。
+`target(i, j)`は、最後にi行j列に置かれるべき断片です。
+行優先の順に位置を埋めていき、1つの断片につき1回選択するので、選択回数は多くなりますが一瞬で求まります。
+*/
+inline Answer planGreedy(Arrangement const & target)
+{
+    const std::size_t div_x = target.div_x(),
+                      div_y = target.div_y(),
+                      n = div_x * div_y;
+
+    // where[k]は断片k(元の位置を行優先で平坦化したもの)の現在位置
+    std::vector<std::size_t> where(n, n);
+    for(auto k: iota(n)){
+        const auto id = target.data()[k];
+        PROCON_ENFORCE(id.get_position().inside(div_x, div_y), format("fragment % is out of the image", id));
+
+        const auto f = id.get_position().flatten(div_x);
+        PROCON_ENFORCE(where[f] == n, format("fragment % appears twice", id));
+        where[f] = f;
+    }
+
+    Arrangement cur(div_x, div_y);
+    Answer dst;
+
+    for(auto i: iota(div_y))
+        for(auto j: iota(div_x)){
+            const Position p(i, j);
+            const auto f = where[target[p].get_position().flatten(div_x)];
+            Position q(f / div_x, f % div_x);
+
+            if(q == p)
+                continue;
+
+            Operation op{q.get_index(), ""};
+            auto move = [&](Direction d){
+                const Position next = q.moved(d);
+                cur.swap_element(q, next);
+                where[cur[q].get_position().flatten(div_x)] = q.flatten(div_x);
+                where[cur[next].get_position().flatten(div_x)] = next.flatten(div_x);
+                op.moves += toChar(d);
+                q = next;
+            };
+
+            // 埋め終わった位置を通らないよう、横に動かしてから上に動かす
+            while(q.col() > p.col()) move(Direction::left);
+            while(q.col() < p.col()) move(Direction::right);
+            while(q.row() > p.row()) move(Direction::up);
+
+            dst.emplace_back(std::move(op));
+        }
+
+    return dst;
+}
+
+
+/** `AnytimeSolver`の各戦略に渡される、探索の状況と結果の提出口です。
+全てのメンバ関数はスレッド安全です。
+*/
+class AnytimeContext
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+
+    AnytimeContext(Problem const & pb, Clock::time_point deadline)
+    : _pb(pb), _deadline(deadline), _stop(false), _targetVersion(0), _bestKey(noKey())
+    {}
+
+
+    Problem const & problem() const { return _pb; }
+    Clock::time_point deadline() const { return _deadline; }
+
+
+    /// 期限を過ぎたか、停止が要求された場合にtrueを返します。戦略はこれを定期的に調べて終了してください。
+    bool stopped() const { return _stop.load(std::memory_order_relaxed) || Clock::now() >= _deadline; }
+
+
+    /// 停止を要求します
+    void stop()
+    {
+        _stop = true;
+        _cv.notify_all();
+    }
+
+
+    /** 復元した配置(最後に各位置に置かれるべき断片)を提出します。
+    `score`は小さいほど良い評価値で、これまでの配置より真に小さい場合のみ採用してtrueを返します。
+    */
+    bool publishTarget(Arrangement const & target, double score)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(_target && !(score < _targetScore))
+            return false;
+
+        _target = target;
+        _targetScore = score;
+        ++_targetVersion;
+        _cv.notify_all();
+        return true;
+    }
+
+
+    /// 現在の最良の配置と、その版数 (配置が更新されるたびに増えます)
+    std::pair<boost::optional<Arrangement>, std::size_t> target() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return std::make_pair(_target, _targetVersion);
+    }
+
+
+    std::size_t targetVersion() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _targetVersion;
+    }
+
+
+    /** 回答を提出します。
+    現在の最良の配置を実現する回答で、これまでの最良の回答より真に良い場合のみ採用してtrueを返します。
+    良さは、選択回数の上限を守っているか、次にコスト(選択回数 * 選択レート + 交換回数 * 交換レート)の順で比べます。
+    配置が更新された後の最初の回答は、コストによらず採用しますが、上限を守った回答を上限を超えた回答で置き換えることはありません。
+    配置がまだ無い間は、何もしない回答のみが採用されます。
+    盤面の外に出る交換操作を含む場合は例外を投げます。
+    */
+    bool publishAnswer(Answer const & ans)
+    {
+        Replay replay(_pb, ans, std::numeric_limits<std::size_t>::max());
+        replay.seek(replay.size());
+        const auto& result = replay.state().arrangement;
+
+        const Key key(ans.size() > _pb.max_select_times(), answerCost(ans, _pb.select_cost(), _pb.change_cost()));
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        const bool reaches = _target ? result == *_target : ans.empty();
+        const bool newTarget = _bestVersion != _targetVersion;
+        const bool better = newTarget ? std::get<0>(key) <= std::get<0>(_bestKey) : key < _bestKey;
+        if(!reaches || !better)
+            return false;
+
+        _best = ans;
+        _bestKey = key;
+        _bestVersion = _targetVersion;
+
+        // 提出の順序を保ったまま、通知はロックの外で行う
+        std::unique_lock<std::mutex> publishLock(_publishMutex);
+        lock.unlock();
+        for(auto& f: _listeners)
+            f(ans);
+
+        return true;
+    }
+
+
+    /// これまでの最良の回答
+    Answer best() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _best;
+    }
+
+
+    /** 回答が採用されるたびに、採用された順に呼ばれる関数を登録します。
+    提出したスレッドで呼ばれます。関数の中でこのオブジェクトのメンバ関数を呼ばないでください。
+    */
+    void onPublish(std::function<void(Answer const &)> f) { _listeners.push_back(std::move(f)); }
+
+
+    /// 配置が更新されるか、停止するか、`until`まで待ちます
+    void waitTarget(std::size_t knownVersion, Clock::time_point until)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait_until(lock, std::min(until, _deadline), [&]{ return _targetVersion != knownVersion || _stop.load(); });
+    }
+
+
+  private:
+    typedef std::tuple<bool, std::size_t> Key;
+
+    Problem const & _pb;
+    Clock::time_point _deadline;
+    std::atomic<bool> _stop;
+
+    mutable std::mutex _mutex;
+    std::mutex _publishMutex;
+    std::condition_variable _cv;
+
+    boost::optional<Arrangement> _target;
+    double _targetScore = 0;
+    std::size_t _targetVersion;
+
+    Answer _best;
+    Key _bestKey;
+    std::size_t _bestVersion = std::size_t(-1);
+
+    std::vector<std::function<void(Answer const &)>> _listeners;
+
+
+    static Key noKey() { return Key(true, std::numeric_limits<std::size_t>::max()); }
+};
+
+
+/** 期限付きで、復元と回答の計画を並行して進めるドライバです。
+
++ 開始直後に、何もしない回答(有効な回答です)を提出します。
++ 戦略(`addStrategy`)はそれぞれ別のスレッドで動き、`publishTarget`で復元した配置を、`publishAnswer`で回答を提出します。
++ 配置が更新されるたびに、ドライバ自身も`planGreedy`と`MoveOptimizer`で回答を作って提出します。
++ 採用された回答は、`outputTo`で指定したファイルに`simulator.cpp`の入力形式で書き出されます。
+  一時ファイルに書いてからrenameするので、ファイルを読む側が書きかけの回答を見ることはありません。
++ 期限になると全ての戦略に停止を要求し、全スレッドの終了を待ってから最良の回答を返します。
+  例外を投げた戦略があった場合は、他の戦略は止めずに続け、全スレッドの終了後に最初の例外を投げなおします。
+  それまでに採用された回答は、`onPublish`や`outputTo`で受け取れています。
+
+Example:
+------------
+AnytimeSolver solver(pb, "img1.ppm");
+solver.outputTo("answer.txt");
+solver.addStrategy([](AnytimeContext& ctx){
+    while(!ctx.stopped()){
+        Arrangement arr = ...;              // 復元
+        ctx.publishTarget(arr, score);
+    }
+});
+
+Answer ans = solver.run(std::chrono::seconds(10));
+------------
+*/
+class AnytimeSolver
+{
+  public:
+    typedef std::function<void(AnytimeContext&)> Strategy;
+
+
+    /// `problemPath`は書き出す回答の1行目(問題画像のパス)で、`outputTo`を使う場合は必須です
+    explicit AnytimeSolver(Problem const & pb, std::string const & problemPath = "")
+    : _pb(pb), _problemPath(problemPath)
+    {}
+
+
+    void addStrategy(Strategy s) { _strategies.push_back(std::move(s)); }
+
+
+    /// 回答が採用されるたびに呼ばれる関数を登録します
+    void onPublish(std::function<void(Answer const &)> f) { _listeners.push_back(std::move(f)); }
+
+
+    /// 採用された回答を書き出すファイルを指定します
+    void outputTo(std::string const & path)
+    {
+        PROCON_ENFORCE(!_problemPath.empty(), "the problem path is required to write answers");
+        _outputPath = path;
+    }
+
+
+    /// 期限まで解きます
+    Answer run(AnytimeContext::Clock::time_point deadline)
+    {
+        AnytimeContext ctx(_pb, deadline);
+
+        for(auto& f: _listeners)
+            ctx.onPublish(f);
+
+        if(!_outputPath.empty())
+            ctx.onPublish([&](Answer const & ans){ writeAtomically(_outputPath, ans); });
+
+        ctx.publishAnswer(Answer());
+
+        std::vector<std::thread> threads;
+        auto joinAll = [&](){
+            ctx.stop();
+            for(auto& th: threads)
+                if(th.joinable())
+                    th.join();
+        };
+        auto scope = scopeExit(joinAll);    // 例外で抜ける場合も全スレッドを待つ
+
+        std::exception_ptr ex;
+        std::mutex exMutex;
+
+        std::atomic<std::size_t> running(_strategies.size());
+        for(auto& s: _strategies)
+            threads.emplace_back([&, s](){
+                try{
+                    s(ctx);
+                }
+                catch(...){
+                    // 1つの戦略の失敗で他の戦略は止めない
+                    std::lock_guard<std::mutex> lock(exMutex);
+                    if(!ex) ex = std::current_exception();
+                }
+
+                if(--running == 0)
+                    ctx.stop();
+            });
+
+        if(_strategies.empty())
+            ctx.stop();
+
+        // 配置が更新されるたびに回答を作る (選択回数の上限を超える回答は提出しない)
+        std::size_t version = 0;
+        MoveOptimizer opt(_pb);
+        auto publishIfValid = [&](Answer const & ans){
+            if(ans.size() <= _pb.max_select_times())
+                ctx.publishAnswer(ans);
+        };
+
+        while(1){
+            const auto t = ctx.target();
+            if(t.second != version && t.first){
+                version = t.second;
+                auto ans = planGreedy(*t.first);
+                publishIfValid(ans);
+                publishIfValid(opt.optimize(ans));
+                continue;
+            }
+
+            if(ctx.stopped())
+                break;
+
+            ctx.waitTarget(version, deadline);
+        }
+
+        joinAll();
+        if(ex)
+            std::rethrow_exception(ex);
+
+        return ctx.best();
+    }
+
+
+    /// ditto
+    template <typename Rep, typename Period>
+    Answer run(std::chrono::duration<Rep, Period> timeLimit)
+    {
+        return run(AnytimeContext::Clock::now() + std::chrono::duration_cast<AnytimeContext::Clock::duration>(timeLimit));
+    }
+
+
+  private:
+    Problem const & _pb;
+    std::string _problemPath;
+    std::string _outputPath;
+    std::vector<Strategy> _strategies;
+    std::vector<std::function<void(Answer const &)>> _listeners;
+
+
+    void writeAtomically(std::string const & path, Answer const & ans) const
+    {
+        const std::string tmp = text(path, ".tmp", std::random_device()());
+        {
+            std::ofstream ofs(tmp);
+            PROCON_ENFORCE(ofs, format("cannot open %", tmp));
+
+            ofs << _problemPath << '\n';
+            writeAnswer(ofs, ans);
+            PROCON_ENFORCE(ofs, format("cannot write %", tmp));
+        }
+
+        if(std::rename(tmp.c_str(), path.c_str()) != 0){
+            std::remove(tmp.c_str());
+            PROCON_ENFORCE(false, format("cannot rename % to %", tmp, path));
+        }
+    }
+};
+
+}} // namespace procon::utils
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace procon { namespace utils {
+
+/** 確保したメモリを個別には解放しない、単調増加のアリーナです。
+
+探索の1反復ごとに`reset`すると、それまでに確保したチャンクを再利用するので、
+定常状態では`malloc`/`free`が全く呼ばれなくなります。
+`reset`後は、それまでに確保した領域を指すポインタやコンテナは使えません。
+
+スレッド安全ではないので、スレッドごとにアリーナを作ってください。
+
+Example:
+------------
+MonotonicArena arena;
+while(searching){
+    arena.reset();
+
+    ArenaVector<Node> beam(ArenaAllocator<Node>(arena));
+    ...
+}
+------------
+*/
+class MonotonicArena
+{
+  public:
+    explicit MonotonicArena(std::size_t chunkSize = 1 << 20)
+    : _chunkSize(chunkSize), _cur(0), _ptr(nullptr), _end(nullptr), _used(0)
+    {}
+
+
+    ~MonotonicArena()
+    {
+        for(auto& c: _chunks)
+            ::operator delete(c.first);
+    }
+
+
+    /// `n`バイトを`align`にそろえて確保します
+    void* allocate(std::size_t n, std::size_t align = alignof(std::max_align_t))
+    {
+        char* p = alignUp(_ptr, align);
+        if(_ptr == nullptr || p + n > _end){
+            nextChunk(n + align);
+            p = alignUp(_ptr, align);
+        }
+
+        _used += (p + n) - _ptr;
+        _ptr = p + n;
+        return p;
+    }
+
+
+    /** オブジェクトを構築します。
+    デストラクタは呼ばれないので、アリーナのメモリしか持たない型に使ってください。
+    */
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+
+    /// 確保した領域を全て破棄します。チャンクは解放せずに再利用します。
+    void reset()
+    {
+        _cur = 0;
+        _used = 0;
+        if(_chunks.empty()){
+            _ptr = _end = nullptr;
+        }else{
+            _ptr = _chunks[0].first;
+            _end = _ptr + _chunks[0].second;
+        }
+    }
+
+
+    /// 確保した領域を全て破棄し、チャンクも解放します
+    void release()
+    {
+        for(auto& c: _chunks)
+            ::operator delete(c.first);
+
+        _chunks.clear();
+        reset();
+    }
+
+
+    /// 前回の`reset`以降に使用したバイト数(アラインメントの詰め物を含む)
+    std::size_t used() const { return _used; }
+
+
+    /// 保持しているチャンクの合計バイト数
+    std::size_t capacity() const
+    {
+        std::size_t sum = 0;
+        for(auto& c: _chunks)
+            sum += c.second;
+
+        return sum;
+    }
+
+
+  private:
+    std::size_t _chunkSize;
+    std::vector<std::pair<char*, std::size_t>> _chunks;
+    std::size_t _cur;
+    char* _ptr;
+    char* _end;
+    std::size_t _used;
+
+
+    MonotonicArena(MonotonicArena const &) = delete;
+    void operator=(MonotonicArena const &) = delete;
+
+
+    static char* alignUp(char* p, std::size_t align)
+    {
+        const auto v = reinterpret_cast<std::uintptr_t>(p);
+        return reinterpret_cast<char*>((v + align - 1) / align * align);
+    }
+
+
+    /// 少なくとも`n`バイトの空きがあるチャンクに移ります
+    void nextChunk(std::size_t n)
+    {
+        std::size_t next = _ptr == nullptr ? 0 : _cur + 1;
+
+        // resetで巻き戻したチャンクのうち、十分な大きさのものを次に使う
+        auto it = std::find_if(_chunks.begin() + std::min(next, _chunks.size()), _chunks.end(),
+            [&](std::pair<char*, std::size_t> const & c){ return c.second >= n; });
+
+        if(it == _chunks.end()){
+            const std::size_t size = std::max(_chunkSize, n);
+            _chunks.emplace_back(static_cast<char*>(::operator new(size)), size);
+            it = _chunks.end() - 1;
+        }
+
+        std::iter_swap(_chunks.begin() + next, it);
+        _cur = next;
+        _ptr = _chunks[_cur].first;
+        _end = _ptr + _chunks[_cur].second;
+    }
+};
+
+
+/** `MonotonicArena`から確保する、標準ライブラリのコンテナ用のアロケータです。
+`deallocate`は何もしません。メモリは`MonotonicArena::reset`でまとめて回収されます。
+*/
+template <typename T>
+class ArenaAllocator
+{
+  public:
+    typedef T value_type;
+
+    ArenaAllocator(MonotonicArena& arena) noexcept : _arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(ArenaAllocator<U> const & other) noexcept : _arena(other.arena()) {}
+
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+
+    void deallocate(T*, std::size_t) noexcept {}
+
+
+    MonotonicArena* arena() const noexcept { return _arena; }
+
+
+    template <typename U>
+    bool operator==(ArenaAllocator<U> const & other) const noexcept { return _arena == other.arena(); }
+
+    template <typename U>
+    bool operator!=(ArenaAllocator<U> const & other) const noexcept { return _arena != other.arena(); }
+
+
+  private:
+    MonotonicArena* _arena;
+};
+
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+
+}} // namespace procon::utils
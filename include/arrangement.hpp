@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "image.hpp"
+#include "types.hpp"
+#include "arena.hpp"
+#include "exception.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 断片の配置を、1つの連続した配列(行優先)で表した型です。
+`std::vector<std::vector<ImageID>>`と違い、1つの状態につきメモリ確保は1回だけです。
+アロケータに`ArenaAllocator`を指定すると、探索ノードごとの確保もアリーナから行えます。
+
+Example:
+------------
+MonotonicArena arena;
+ArenaArrangement s(swpImage.get_index(), arena);    // アリーナ上に複製
+s.swap_element(Position(0, 0), Position(0, 1));
+
+SwappedImage img(pb.dividedImage(), s.get_index()); // 元の形式に戻す
+------------
+*/
+template <typename Alloc = std::allocator<ImageID>>
+class BasicArrangement
+{
+  public:
+    typedef Alloc allocator_type;
+
+
+    /// 恒等配置 (i行j列に断片(i, j)がある) を作ります
+    BasicArrangement(std::size_t div_x, std::size_t div_y, Alloc const & alloc = Alloc())
+    : _div_x(div_x), _div_y(div_y), _ids(alloc)
+    {
+        _ids.reserve(div_x * div_y);
+        for(auto i: iota(div_y))
+            for(auto j: iota(div_x))
+                _ids.emplace_back(i, j);
+    }
+
+
+    explicit BasicArrangement(std::vector<std::vector<ImageID>> const & idx, Alloc const & alloc = Alloc())
+    : _div_x(idx.empty() ? 0 : idx[0].size()), _div_y(idx.size()), _ids(alloc)
+    {
+        _ids.reserve(_div_x * _div_y);
+        for(auto& row: idx){
+            PROCON_ENFORCE(row.size() == _div_x, "rows of the index have different lengths");
+            _ids.insert(_ids.end(), row.begin(), row.end());
+        }
+    }
+
+
+    /// 他のアロケータの配置を複製します
+    template <typename A2>
+    BasicArrangement(BasicArrangement<A2> const & other, Alloc const & alloc)
+    : _div_x(other.div_x()), _div_y(other.div_y()), _ids(other.data(), other.data() + other.size(), alloc)
+    {}
+
+
+    std::size_t div_x() const { return _div_x; }
+    std::size_t div_y() const { return _div_y; }
+    std::size_t size() const { return _ids.size(); }
+
+    const ImageID* data() const { return _ids.data(); }
+    ImageID* data() { return _ids.data(); }
+
+
+    ImageID& operator()(std::size_t r, std::size_t c) { return _ids[r * _div_x + c]; }
+    ImageID const & operator()(std::size_t r, std::size_t c) const { return _ids[r * _div_x + c]; }
+
+    ImageID& operator[](Position p) { return _ids[p.flatten(_div_x)]; }
+    ImageID const & operator[](Position p) const { return _ids[p.flatten(_div_x)]; }
+
+
+    void swap_element(Position a, Position b)
+    {
+        std::swap((*this)[a], (*this)[b]);
+    }
+
+
+    void swap_element(Index2D a, Index2D b)
+    {
+        std::swap((*this)(a[0], a[1]), (*this)(b[0], b[1]));
+    }
+
+
+    /// `SwappedImage`などで使う`std::vector<std::vector<ImageID>>`の形式に変換します
+    std::vector<std::vector<ImageID>> get_index() const
+    {
+        std::vector<std::vector<ImageID>> dst(_div_y);
+        for(auto i: iota(_div_y))
+            dst[i].assign(_ids.begin() + i * _div_x, _ids.begin() + (i + 1) * _div_x);
+
+        return dst;
+    }
+
+
+    template <typename A2>
+    bool operator==(BasicArrangement<A2> const & other) const
+    {
+        return _div_x == other.div_x() && _div_y == other.div_y()
+            && std::equal(_ids.begin(), _ids.end(), other.data());
+    }
+
+
+    template <typename A2>
+    bool operator!=(BasicArrangement<A2> const & other) const { return !(*this == other); }
+
+
+    void to_string(std::ostream& s) const
+    {
+        swrite(s, get_index());
+    }
+
+
+  private:
+    std::size_t _div_x;
+    std::size_t _div_y;
+    std::vector<ImageID, Alloc> _ids;
+};
+
+
+typedef BasicArrangement<> Arrangement;
+typedef BasicArrangement<ArenaAllocator<ImageID>> ArenaArrangement;
+
+}} // namespace procon::utils
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "image.hpp"
+#include "types.hpp"
+#include "range.hpp"
+#include "cost_table.hpp"
+#include "exception.hpp"
+
+
+namespace procon { namespace utils {
+
+/** `SwappedImage`の配置全体の整合性を、隣接する全ての断片の組の接合部のコスト(`CostTable`)の和で評価します。
+
+局所探索では`swap_element`を非常に多く呼ぶので、総和を保持しておき、交換で変わる接合部(高々8つ)だけを計算しなおします。
+`swapDelta`で交換した場合の変化量を、交換せずにO(1)で求められるので、焼きなまし法や2-optの近傍の評価に使えます。
+
+断片の交換は、必ずこのオブジェクトの`swap_element`を通してください。`SwappedImage`を直接変更した場合は`rescore`を呼んでください。
+元の向きの断片のみを扱います。
+表を複製している場合(`CostTable::forCurrentNode`)は、構築したスレッドのNUMAノードの複製を使うので、使うスレッドで構築してください。
+
+Example:
+------------
+SwappedImage img(pb.dividedImage(), idx);
+ArrangementScorer scorer(img, CostTable(pb.view()));
+
+if(scorer.swapDelta(a, b) < 0)
+    scorer.swap_element(a, b);      // imgも交換される
+
+writeln(scorer.total());
+------------
+*/
+class ArrangementScorer
+{
+  public:
+    ArrangementScorer(SwappedImage& img, CostTable const & costs)
+    : _img(img), _table(costs), _costs(_table.forCurrentNode()), _div_x(img.div_x()), _div_y(img.div_y())
+    {
+        PROCON_ENFORCE(costs.size() == _div_x * _div_y, "the cost table does not belong to the image");
+        rescore();
+    }
+
+
+    std::size_t div_x() const { return _div_x; }
+    std::size_t div_y() const { return _div_y; }
+
+    SwappedImage const & image() const { return _img; }
+
+
+    /// 接合部のコストの総和
+    double total() const { return _total; }
+
+
+    /// 位置(行優先)ごとの断片の番号 (問題画像中の位置(r, c)について`r * div_x + c`)
+    std::vector<uint16_t> const & fragments() const { return _frag; }
+
+
+    /// `SwappedImage`の配置から総和を計算しなおします
+    void rescore()
+    {
+        auto const & idx = _img.get_index();
+        _frag.resize(_div_x * _div_y);
+        for(auto i: iota(_div_y))
+            for(auto j: iota(_div_x)){
+                const auto id = idx[i][j];
+                PROCON_ENFORCE(id.orientation() == Orientation::upright, "rotated fragments are not supported");
+                _frag[i * _div_x + j] = static_cast<uint16_t>(id.get_position().flatten(_div_x));
+            }
+
+        _total = 0;
+        for(auto i: iota(_div_y))
+            for(auto j: iota(_div_x)){
+                const Position p(i, j);
+                if(j + 1 < _div_x) _total += seam(p, Direction::right);
+                if(i + 1 < _div_y) _total += seam(p, Direction::down);
+            }
+    }
+
+
+    /// 位置pの断片と、その方向dに隣接する断片との接合部のコスト
+    float seam(Position p, Direction d) const
+    {
+        return _costs.cost(_frag[p.flatten(_div_x)], _frag[p.moved(d).flatten(_div_x)], d);
+    }
+
+
+    /// 位置pの断片が接する全ての接合部のコストの和
+    double cellCost(Position p) const
+    {
+        double sum = 0;
+        for(int d = 0; d < 4; ++d){
+            const auto dir = static_cast<Direction>(d);
+            if(p.moved(dir).inside(_div_x, _div_y))
+                sum += seam(p, dir);
+        }
+
+        return sum;
+    }
+
+
+    /** 位置aと位置bの断片を交換した場合の、総和の変化量を返します。配置は変更しません。
+    a, bのそれぞれに接する接合部(高々8つ、隣接していれば共有する1つは1回だけ)のみを計算します。
+    */
+    double swapDelta(Position a, Position b) const
+    {
+        if(a == b)
+            return 0;
+
+        const std::size_t fa = _frag[a.flatten(_div_x)],
+                          fb = _frag[b.flatten(_div_x)];
+
+        // 交換後に位置qにある断片
+        auto after = [&](Position q){
+            return q == a ? fb : (q == b ? fa : _frag[q.flatten(_div_x)]);
+        };
+
+        double delta = 0;
+        for(int d = 0; d < 4; ++d){
+            const auto dir = static_cast<Direction>(d);
+
+            const Position na = a.moved(dir);
+            if(na.inside(_div_x, _div_y))
+                delta += _costs.cost(fb, after(na), dir) - seam(a, dir);
+
+            // aとbの間の接合部はaの側で数えた
+            const Position nb = b.moved(dir);
+            if(nb.inside(_div_x, _div_y) && nb != a)
+                delta += _costs.cost(fa, after(nb), dir) - seam(b, dir);
+        }
+
+        return delta;
+    }
+
+
+    /// ditto
+    double swapDelta(Index2D a, Index2D b) const { return swapDelta(Position(a), Position(b)); }
+
+
+    /** 位置aと位置bの断片を交換し、総和を差分更新します。`SwappedImage`の配置も交換します。
+    総和の変化量を返します。
+    */
+    double swap_element(Position a, Position b)
+    {
+        const double delta = swapDelta(a, b);
+        std::swap(_frag[a.flatten(_div_x)], _frag[b.flatten(_div_x)]);
+        _img.swap_element(a.get_index(), b.get_index());
+        _total += delta;
+        return delta;
+    }
+
+
+    /// ditto
+    double swap_element(Index2D a, Index2D b) { return swap_element(Position(a), Position(b)); }
+
+
+  private:
+    SwappedImage& _img;
+    CostTable _table;       // _costsが指す表の寿命を保つ
+    CostTableView _costs;
+    std::size_t _div_x;
+    std::size_t _div_y;
+    std::vector<uint16_t> _frag;    // 位置(行優先) -> 断片の番号
+    double _total;
+};
+
+}} // namespace procon::utils
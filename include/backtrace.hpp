@@ -239,14 +239,14 @@ namespace boost {
     namespace stack_trace {
         #if defined(BOOST_HAVE_EXECINFO)
         
-        int trace(void **array,int n)
+        inline int trace(void **array,int n)
         {
             return :: backtrace(array,n);
         }
         
         #elif defined(BOOST_MSVC)
 
-        int trace(void **array,int n)
+        inline int trace(void **array,int n)
         {
             if(n>=63)
                 n=62;
@@ -255,7 +255,7 @@ namespace boost {
 
         #else
 
-        int trace(void ** /*array*/,int /*n*/)
+        inline int trace(void ** /*array*/,int /*n*/)
         {
             return 0;
         }
@@ -264,7 +264,7 @@ namespace boost {
         
         #if defined(BOOST_HAVE_DLADDR) && defined(BOOST_HAVE_ABI_CXA_DEMANGLE)
         
-        std::string get_symbol(void *ptr)
+        inline std::string get_symbol(void *ptr)
         {
             if(!ptr)
                 return std::string();
@@ -300,7 +300,7 @@ namespace boost {
            return res.str();
         }
 
-        std::string get_symbols(void *const *addresses,int size)
+        inline std::string get_symbols(void *const *addresses,int size)
         {
             std::string res;
             for(int i=0;i<size;i++) {
@@ -312,7 +312,7 @@ namespace boost {
             }
             return res;
         }
-        void write_symbols(void *const *addresses,int size,std::ostream &out)
+        inline void write_symbols(void *const *addresses,int size,std::ostream &out)
         {
             for(int i=0;i<size;i++) {
                 std::string tmp = get_symbol(addresses[i]);
@@ -324,7 +324,7 @@ namespace boost {
         }
 
         #elif defined(BOOST_HAVE_EXECINFO)
-        std::string get_symbol(void *address)
+        inline std::string get_symbol(void *address)
         {
             char ** ptr = backtrace_symbols(&address,1);
             try {
@@ -341,7 +341,7 @@ namespace boost {
             }
         }
         
-        std::string get_symbols(void * const *address,int size)
+        inline std::string get_symbols(void * const *address,int size)
         {
             char ** ptr = backtrace_symbols(address,size);
             try {
@@ -363,7 +363,7 @@ namespace boost {
         }
 
         
-        void write_symbols(void *const *addresses,int size,std::ostream &out)
+        inline void write_symbols(void *const *addresses,int size,std::ostream &out)
         {
             char ** ptr = backtrace_symbols(addresses,size);
             try {
@@ -401,7 +401,7 @@ namespace boost {
             }
         }
         
-        std::string get_symbol(void *ptr)
+        inline std::string get_symbol(void *ptr)
         {
             if(ptr==0)
                 return std::string();
@@ -430,7 +430,7 @@ namespace boost {
             return ss.str();
         }
 
-        std::string get_symbols(void *const *addresses,int size)
+        inline std::string get_symbols(void *const *addresses,int size)
         {
             std::string res;
             for(int i=0;i<size;i++) {
@@ -442,7 +442,7 @@ namespace boost {
             }
             return res;
         }
-        void write_symbols(void *const *addresses,int size,std::ostream &out)
+        inline void write_symbols(void *const *addresses,int size,std::ostream &out)
         {
             for(int i=0;i<size;i++) {
                 std::string tmp = get_symbol(addresses[i]);
@@ -455,7 +455,7 @@ namespace boost {
         
         #else
 
-        std::string get_symbol(void *ptr)
+        inline std::string get_symbol(void *ptr)
         {
             if(!ptr)
                 return std::string();
@@ -465,7 +465,7 @@ namespace boost {
             return res.str();
         }
 
-        std::string get_symbols(void *const *ptrs,int size)
+        inline std::string get_symbols(void *const *ptrs,int size)
         {
             if(!ptrs)
                 return std::string();
@@ -475,7 +475,7 @@ namespace boost {
             return res.str();
         }
 
-        void write_symbols(void *const *addresses,int size,std::ostream &out)
+        inline void write_symbols(void *const *addresses,int size,std::ostream &out)
         {
             for(int i=0;i<size;i++) {
                 if(addresses[i]!=0)
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "image.hpp"
+#include "types.hpp"
+#include "range.hpp"
+#include "memory_policy.hpp"
+#include "exception.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 二つの画素列の、1画素あたりの二乗誤差を返します
+*/
+inline float edgeDissimilarity(const uint8_t* p, const uint8_t* q, std::size_t len)
+{
+    uint64_t sum = 0;
+    for(std::size_t i = 0; i < len * 3; ++i){
+        const int diff = int(p[i]) - int(q[i]);
+        sum += diff * diff;
+    }
+
+    return len ? static_cast<float>(sum) / len : 0.0f;
+}
+
+
+/** 各断片の4辺の画素列(エッジ)です。
+断片kの方向dのエッジは`edge(k, d)`で、右と左は上から下、上と下は左から右の順に`length(d)`画素並んでいます。
+断片の番号は、問題画像中の位置(r, c)について`r * div_x + c`です。
+
+`withOrientations`を指定すると、8通りの向き(`Orientation`)に置いたときのエッジも予め取り出しておくので、
+回転・反転した断片どうしの相性も、画像を回転せずに元の向きと同じ手間で計算できます。
+この場合、断片は正方形である必要があります。
+
+Example:
+------------
+FragmentEdges edges(pb.view(), true);
+float c = edges.cost(ImageID(0, 1, Orientation::rot90), ImageID(2, 3, Orientation::flipped), Direction::right);
+------------
+*/
+class FragmentEdges
+{
+  public:
+    FragmentEdges() : _div_x(0), _div_y(0), _ww(0), _hh(0), _orientations(1) {}
+
+
+    /// 問題画像から各断片のエッジを並列に取り出します
+    explicit FragmentEdges(DividedImageView img, bool withOrientations = false)
+    : _div_x(img.div_x()), _div_y(img.div_y()),
+      _ww(img.width() / img.div_x()), _hh(img.height() / img.div_y()),
+      _orientations(withOrientations ? numOrientations : 1)
+    {
+        PROCON_ENFORCE(!withOrientations || _ww == _hh, "fragments must be square to be rotated");
+
+        auto buf = std::make_shared<std::vector<uint8_t>>(bytes());
+        uint8_t* p = buf->data();
+
+        DividedImage::parallel_foreach(img, [&](std::size_t i, std::size_t j){
+            const auto e = img.get_element(i, j);
+
+            for(std::size_t o = 0; o < _orientations; ++o){
+                uint8_t* dst = p + ((i * _div_x + j) * _orientations + o) * stride();
+
+                for(auto d: {Direction::right, Direction::up, Direction::left, Direction::down}){
+                    for(std::size_t k = 0; k < length(d); ++k){
+                        const std::size_t y = d == Direction::up ? 0 : d == Direction::down ? _hh - 1 : k,
+                                          x = d == Direction::left ? 0 : d == Direction::right ? _ww - 1 : k;
+                        const auto src = orientedSource(static_cast<Orientation>(o), y, x, _hh, _ww);
+                        std::memcpy(dst + k * 3, e.row(src[0]) + src[1] * 3, 3);
+                    }
+                    dst += length(d) * 3;
+                }
+            }
+        });
+
+        _data = std::shared_ptr<const uint8_t>(buf, buf->data());
+    }
+
+
+    /// 既にメモリ上にあるエッジを使います。`data`の寿命は`shared_ptr`が管理します。
+    FragmentEdges(std::size_t div_x, std::size_t div_y, std::size_t ww, std::size_t hh, std::shared_ptr<const uint8_t> data,
+                  std::size_t orientations = 1)
+    : _div_x(div_x), _div_y(div_y), _ww(ww), _hh(hh), _orientations(orientations), _data(std::move(data)) {}
+
+
+    std::size_t div_x() const { return _div_x; }
+    std::size_t div_y() const { return _div_y; }
+    std::size_t size() const { return _div_x * _div_y; }
+
+    /// 断片の幅と高さ
+    std::size_t fragment_width() const { return _ww; }
+    std::size_t fragment_height() const { return _hh; }
+
+    /// 取り出してある向きの数 (1か`numOrientations`)
+    std::size_t orientations() const { return _orientations; }
+
+
+    std::size_t length(Direction d) const { return (static_cast<int>(d) & 1) ? _ww : _hh; }
+
+
+    /// 1断片の1つの向きあたりのバイト数
+    std::size_t stride() const { return (_ww + _hh) * 2 * 3; }
+    std::size_t bytes() const { return stride() * size() * _orientations; }
+    const uint8_t* data() const { return _data.get(); }
+
+
+    /// 向き`o`で置いた断片kの、BGRの画素列を返します
+    const uint8_t* edge(std::size_t k, Direction d, Orientation o = Orientation::upright) const
+    {
+        PROCON_RANGE_CHECK(static_cast<std::size_t>(o) < _orientations, "orientations are not extracted");
+
+        const uint8_t* p = _data.get() + (k * _orientations + static_cast<std::size_t>(o)) * stride();
+        switch(d)
+        {
+          case Direction::right: return p;
+          case Direction::up:    return p + _hh * 3;
+          case Direction::left:  return p + (_hh + _ww) * 3;
+          default:               return p + (_hh * 2 + _ww) * 3;
+        }
+    }
+
+
+    const uint8_t* edge(ImageID id, Direction d) const
+    {
+        const auto p = id.get_position();
+        return edge(p.row() * _div_x + p.col(), d, id.orientation());
+    }
+
+
+    /// 断片bを断片aの方向dに隣接して置いたときの非類似度を、向きを考慮して計算します
+    float cost(ImageID a, ImageID b, Direction d) const
+    {
+        return edgeDissimilarity(edge(a, d), edge(b, opposite(d)), length(d));
+    }
+
+
+  private:
+    std::size_t _div_x;
+    std::size_t _div_y;
+    std::size_t _ww;
+    std::size_t _hh;
+    std::size_t _orientations;
+    std::shared_ptr<const uint8_t> _data;
+};
+
+
+/** `CostTable`の表を所有せずに指すビューです。
+ポインタと大きさを持つだけなのでコピーは軽く、ワーカーごとに持っても負担になりません。
+指している`CostTable`より長く使ってはいけません。
+*/
+class CostTableView
+{
+  public:
+    CostTableView() : _data(nullptr), _n(0) {}
+    CostTableView(const float* data, std::size_t n) : _data(data), _n(n) {}
+
+
+    std::size_t size() const { return _n; }
+    const float* data() const { return _data; }
+
+
+    float cost(std::size_t a, std::size_t b, Direction d) const
+    {
+        return _data[(a * _n + b) * 4 + static_cast<int>(d)];
+    }
+
+
+  private:
+    const float* _data;
+    std::size_t _n;
+};
+
+
+/** 断片の組の、向きごとの相性(非類似度)の表です。
+`cost(a, b, d)`は、断片bを断片aの方向dに隣接して置いたときの、接する画素列の1画素あたりの二乗誤差で、小さいほど相性が良いです。
+表は`(a * n + b) * 4 + d`の順に並んだfloatの配列で、n = div_x * div_y です。
+元の向きの断片どうしのみを扱います。回転・反転した断片どうしは`FragmentEdges::cost`を使ってください。
+
+表は全てのワーカースレッドから読まれるので、`MemoryPolicy`で置き場所を指定できます。
+`MemoryPolicy::replicatedReadMostly()`を指定した場合は、各スレッドの最初に`forCurrentNode()`で
+そのスレッドのNUMAノードにある複製を指すビューを取り出して使ってください。
+`ArrangementScorer`は構築したスレッドの複製を使い、`StripAssembler`はワーカーごとに一度だけ複製を選びます。
+
+Example:
+------------
+const CostTable table(pb.view(), MemoryPolicy::replicatedReadMostly());
+
+std::thread th([&]{
+    const CostTableView local = table.forCurrentNode();
+    ... local.cost(a, b, Direction::right) ...
+});
+------------
+*/
+class CostTable
+{
+  public:
+    CostTable() : _n(0) {}
+
+
+    /// 問題画像から表を並列に計算します
+    explicit CostTable(DividedImageView img, MemoryPolicy policy = MemoryPolicy())
+    : CostTable(img, FragmentEdges(img), policy) {}
+
+
+    /// 取り出し済みのエッジから表を並列に計算します
+    CostTable(DividedImageView img, FragmentEdges const & edges, MemoryPolicy policy = MemoryPolicy())
+    : _n(edges.size())
+    {
+        PROCON_ENFORCE(img.div_x() == edges.div_x() && img.div_y() == edges.div_y(),
+            "the edges do not belong to the image");
+
+        // 並列に書き込むので、interleavedの場合はページが各ノードに分散される
+        auto buf = allocateArray<float>(values(), policy);
+        float* p = buf.get();
+
+        DividedImage::parallel_foreach(img, [&](std::size_t i, std::size_t j){
+            const std::size_t a = i * img.div_x() + j;
+            for(std::size_t b = 0; b < _n; ++b)
+                for(int d = 0; d < 4; ++d){
+                    const auto dir = static_cast<Direction>(d);
+                    p[(a * _n + b) * 4 + d] = edgeDissimilarity(edges.edge(a, dir), edges.edge(b, opposite(dir)), edges.length(dir));
+                }
+        });
+
+        _data = buf;
+        if(policy.placement == MemoryPolicy::Placement::replicated){
+            // 計算に使った領域は複製を作った後に解放し、構築したスレッドのノードの複製を指す
+            _replicas = replicatePerNode<float>(_data, values(), policy);
+            _data = _replicas[currentNumaNode() % _replicas.size()];
+        }
+    }
+
+
+    /// 既にメモリ上にある表を使います
+    CostTable(std::size_t n, std::shared_ptr<const float> data)
+    : _n(n), _data(std::move(data)) {}
+
+
+    std::size_t size() const { return _n; }
+    std::size_t values() const { return _n * _n * 4; }
+    const float* data() const { return _data.get(); }
+
+
+    float cost(std::size_t a, std::size_t b, Direction d) const
+    {
+        return _data.get()[(a * _n + b) * 4 + static_cast<int>(d)];
+    }
+
+
+    /// 表全体を指すビューを返します
+    CostTableView view() const { return CostTableView(_data.get(), _n); }
+
+
+    /** 呼び出したスレッドのNUMAノードにある複製を指すビューを返します。
+    複製していない場合は、`view()`と同じです。表も複製の配列もコピーしません。
+    */
+    CostTableView forCurrentNode() const
+    {
+        if(_replicas.size() > 1)
+            return CostTableView(_replicas[currentNumaNode() % _replicas.size()].get(), _n);
+
+        return view();
+    }
+
+
+  private:
+    std::size_t _n;
+    std::shared_ptr<const float> _data;
+    std::vector<std::shared_ptr<const float>> _replicas;    // NUMAノードごとの複製
+};
+
+}} // namespace procon::utils
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <boost/optional.hpp>
+#include "exception.hpp"
+#include "dwrite.hpp"
+
+
+namespace procon { namespace utils {
+
+/** `PROCON_CHECK`で作られるエラーです。
+メッセージは文字列リテラルを指すだけなので、作るときにメモリ確保もスタックトレースの取得もしません。
+*/
+struct ErrorInfo
+{
+    const char* msg;
+    const char* file;
+    std::size_t line;
+
+
+    void to_string(std::ostream& s) const
+    {
+        s << file << "(" << line << "): " << msg;
+    }
+};
+
+
+/// `Expected`をエラーで構築するための型です。`makeUnexpected`で作ります。
+template <typename E>
+struct Unexpected
+{
+    E value;
+};
+
+
+template <typename E>
+Unexpected<std::decay_t<E>> makeUnexpected(E&& e)
+{
+    return Unexpected<std::decay_t<E>>{std::forward<E>(e)};
+}
+
+
+/** 値か、エラーのどちらかを保持する型です。
+`PROCON_ENFORCE`と違い、失敗しても例外を投げないので、ループの中の範囲検査などにも使えます。
+`CollectException`と同じく、`onSuccess`と`onFailure`で結果を受け取れます。
+
+Example:
+------------
+Expected<Position> step(Position p, Direction d, std::size_t div_x, std::size_t div_y)
+{
+    const auto next = p.moved(d);
+    PROCON_CHECK(next.inside(div_x, div_y), "out of the image");
+    return next;
+}
+
+step(p, Direction::up, 16, 16)
+.onSuccess([&](Position q){ p = q; })
+.onFailure([&](ErrorInfo const & e){ writeln(e); });
+------------
+*/
+template <typename T, typename E = ErrorInfo>
+class Expected
+{
+  public:
+    typedef T value_type;
+    typedef E error_type;
+
+
+    Expected(T const & v) : _value(v), _error() {}
+    Expected(T&& v) : _value(std::move(v)), _error() {}
+
+    template <typename E2>
+    Expected(Unexpected<E2> e) : _value(), _error(std::move(e.value)) {}
+
+
+    bool has_value() const { return static_cast<bool>(_value); }
+    explicit operator bool() const { return has_value(); }
+
+
+    /// 値を返します。エラーを保持している場合は例外を投げます。
+    T& value() &
+    {
+        PROCON_ENFORCE(has_value(), format("bad expected access: %", _error));
+        return *_value;
+    }
+
+
+    /// ditto
+    T const & value() const &
+    {
+        PROCON_ENFORCE(has_value(), format("bad expected access: %", _error));
+        return *_value;
+    }
+
+
+    /// ditto
+    T value() &&
+    {
+        PROCON_ENFORCE(has_value(), format("bad expected access: %", _error));
+        return std::move(*_value);
+    }
+
+
+    T& operator*() { return *_value; }
+    T const & operator*() const { return *_value; }
+    T* operator->() { return &*_value; }
+    T const * operator->() const { return &*_value; }
+
+
+    /// 値を保持していなければ`v`を返します
+    template <typename U>
+    T value_or(U&& v) const { return _value ? *_value : static_cast<T>(std::forward<U>(v)); }
+
+
+    /// エラーを返します。値を保持している場合の値は未規定です。
+    E const & error() const { return _error; }
+
+
+    template <typename F>
+    Expected& onSuccess(F f)
+    {
+        if(_value)
+            f(*_value);
+
+        return *this;
+    }
+
+
+    template <typename F>
+    Expected& onFailure(F f)
+    {
+        if(!_value)
+            f(_error);
+
+        return *this;
+    }
+
+
+  private:
+    boost::optional<T> _value;
+    E _error;
+};
+
+
+/** 値を持たない`Expected`です。成功したかどうかとエラーのみを保持します。
+*/
+template <typename E>
+class Expected<void, E>
+{
+  public:
+    typedef void value_type;
+    typedef E error_type;
+
+
+    Expected() : _ok(true), _error() {}
+
+    template <typename E2>
+    Expected(Unexpected<E2> e) : _ok(false), _error(std::move(e.value)) {}
+
+
+    bool has_value() const { return _ok; }
+    explicit operator bool() const { return _ok; }
+
+
+    /// エラーを保持している場合は例外を投げます
+    void value() const
+    {
+        PROCON_ENFORCE(_ok, format("bad expected access: %", _error));
+    }
+
+
+    E const & error() const { return _error; }
+
+
+    template <typename F>
+    Expected& onSuccess(F f)
+    {
+        if(_ok)
+            f();
+
+        return *this;
+    }
+
+
+    template <typename F>
+    Expected& onFailure(F f)
+    {
+        if(!_ok)
+            f(_error);
+
+        return *this;
+    }
+
+
+  private:
+    bool _ok;
+    E _error;
+};
+
+
+/** `v`が偽であれば、`ErrorInfo`を保持した`Expected`を返して関数を抜けます。
+関数の戻り値の型は`Expected<T>`(エラーの型が`ErrorInfo`)である必要があります。
+`msg`は文字列リテラルにしてください。
+*/
+#define PROCON_CHECK(v, msg)                                                                        \
+    do{                                                                                             \
+        if(!(v))                                                                                    \
+            return procon::utils::makeUnexpected(procon::utils::ErrorInfo{msg, __FILE__, __LINE__});\
+    }while(0)
+
+
+/** `v`が偽であれば、エラー`err`を保持した`Expected`を返して関数を抜けます。
+任意のエラーの型(たとえばエラーコードの`enum`)を使う場合はこちらを使います。
+*/
+#define PROCON_CHECK_OR(v, err)                                     \
+    do{                                                             \
+        if(!(v))                                                    \
+            return procon::utils::makeUnexpected(err);              \
+    }while(0)
+
+
+/** `CollectException`に変換します。
+エラーは、その文字列表現をメッセージとする`std::runtime_error`になるので、`Ex`はその基底クラスである必要があります。
+*/
+template <typename Ex = std::runtime_error, typename T, typename E>
+CollectException<T, Ex> toCollectException(Expected<T, E> e)
+{
+    static_assert(std::is_base_of<Ex, std::runtime_error>::value, "Ex must be a base of std::runtime_error");
+
+    if(e)
+        return CollectException<T, Ex>(std::move(*e));
+    else
+        return CollectException<T, Ex>(std::make_exception_ptr(std::runtime_error(text(e.error()))));
+}
+
+
+/** `CollectException`から変換します。エラーは例外の`what()`の文字列になります。
+`Ex`以外の例外を保持している場合は、その例外が投げられます。
+*/
+template <typename T, typename Ex>
+Expected<T, std::string> fromCollectException(CollectException<T, Ex>& c)
+{
+    boost::optional<Expected<T, std::string>> dst;
+    c.onSuccess([&](T&& v){ dst = Expected<T, std::string>(std::forward<T>(v)); })
+     .onFailure([&](Ex& ex){ dst = Expected<T, std::string>(makeUnexpected(std::string(ex.what()))); });
+
+    return std::move(*dst);
+}
+
+
+/// ditto
+template <typename T, typename Ex>
+Expected<T, std::string> fromCollectException(CollectException<T, Ex>&& c)
+{
+    return fromCollectException(c);
+}
+
+}} // namespace procon::utils
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+#include "image.hpp"
+#include "types.hpp"
+#include "arrangement.hpp"
+#include "range.hpp"
+#include "thread_pool.hpp"
+#include "exception.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 見た目がほとんど同じで、入れ替えても画像が変わらない断片をまとめたものです。
+
+空や壁のような平坦な領域を多く含む画像では、同じような断片がたくさんでき、復元の探索で曖昧な候補を何度も調べることになります。
+同じクラスタの断片を同一視すれば、探索の分岐や、置換表に載る状態の数を減らせます。
+
++ 各断片の、全体と4辺それぞれの画素の平均(シグネチャ)を並列に計算し、シグネチャを量子化した値でバケットに分けます。
++ 同じバケットの断片どうしのみを画素ごとに比べ、1画素あたりの二乗誤差が`tolerance`以下なら同じクラスタにします。
+  バケットごとに独立なので、これも並列に行います。
+
+クラスタは断片の番号(問題画像中の位置(r, c)について`r * div_x + c`)の小さい順に作られ、
+各クラスタの代表はクラスタ内で最も番号の小さい断片です。結果はスレッド数によりません。
+`tolerance`が0(デフォルト)の場合は、画素が完全に一致する断片のみをまとめます。
+
+Example:
+------------
+FragmentClusters clusters(pb.view());
+
+MoveOptimizer opt(pb);
+opt.setTileClasses(clusters.canonicalTiles());      // 同じ断片どうしの入れ替えを省く
+
+std::unordered_set<uint64_t> visited;
+visited.insert(clusters.hash(arrangement));         // 同一視した配置のハッシュ
+------------
+*/
+class FragmentClusters
+{
+  public:
+    FragmentClusters() : _div_x(0), _div_y(0), _ww(0), _hh(0) {}
+
+
+    explicit FragmentClusters(DividedImageView img, float tolerance = 0, std::size_t nThreads = std::thread::hardware_concurrency())
+    : _div_x(img.div_x()), _div_y(img.div_y()),
+      _ww(img.width() / img.div_x()), _hh(img.height() / img.div_y()),
+      _cluster(img.div_x() * img.div_y())
+    {
+        PROCON_ENFORCE(tolerance >= 0, "tolerance must be non-negative");
+
+        const std::size_t n = size();
+        std::vector<Signature> sigs(n);
+        DividedImage::parallel_foreach(img, [&](std::size_t i, std::size_t j){
+            sigs[i * _div_x + j] = signature(img.get_element(i, j));
+        }, nThreads);
+
+        // 誤差が許容範囲内なら平均の差もおよそsqrt(tolerance)以内なので、それより粗く量子化する
+        // (量子化の境界をまたぐ断片はまとめられないが、異なる断片をまとめることはない)
+        const double step = tolerance > 0 ? 4 * std::sqrt(static_cast<double>(tolerance)) : 0;
+        std::map<Key, std::vector<std::size_t>> bucketMap;
+        for(auto k: iota(n))
+            bucketMap[quantize(sigs[k], step)].push_back(k);
+
+        std::vector<std::vector<std::size_t>> buckets;
+        for(auto& e: bucketMap)
+            buckets.push_back(std::move(e.second));
+
+        // leader[k]は断片kと同じクラスタの、最も番号の小さい断片
+        std::vector<std::size_t> leader(n);
+        defaultThreadPool().parallel_for(iota(buckets.size()), [&](std::size_t b){
+            std::vector<std::size_t> leaders;
+            for(auto k: buckets[b]){
+                leader[k] = k;
+                for(auto l: leaders)
+                    if(similar(img.get_element(l / _div_x, l % _div_x), img.get_element(k / _div_x, k % _div_x), tolerance)){
+                        leader[k] = l;
+                        break;
+                    }
+
+                if(leader[k] == k)
+                    leaders.push_back(k);
+            }
+        }, std::max<std::size_t>(nThreads, 1));
+
+        for(auto k: iota(n)){
+            if(leader[k] == k){
+                _cluster[k] = _members.size();
+                _members.emplace_back();
+            }else
+                _cluster[k] = _cluster[leader[k]];
+
+            _members[_cluster[k]].push_back(k);
+        }
+    }
+
+
+    std::size_t div_x() const { return _div_x; }
+    std::size_t div_y() const { return _div_y; }
+
+    /// 断片の数
+    std::size_t size() const { return _div_x * _div_y; }
+
+    /// クラスタの数
+    std::size_t numClusters() const { return _members.size(); }
+
+
+    /// 断片kのクラスタの番号
+    std::size_t clusterOf(std::size_t k) const { return _cluster[k]; }
+    std::size_t clusterOf(ImageID id) const { return clusterOf(flatten(id)); }
+
+
+    /// c番目のクラスタに属する断片 (昇順)
+    std::vector<std::size_t> const & members(std::size_t c) const { return _members[c]; }
+
+
+    /// 断片kのクラスタの代表
+    std::size_t representative(std::size_t k) const { return _members[_cluster[k]].front(); }
+
+
+    bool interchangeable(std::size_t a, std::size_t b) const { return _cluster[a] == _cluster[b]; }
+    bool interchangeable(ImageID a, ImageID b) const { return interchangeable(flatten(a), flatten(b)) && a.orientation() == b.orientation(); }
+
+
+    /// 断片をそのクラスタの代表に置き換えます。向きは保ちます。
+    ImageID canonical(ImageID id) const
+    {
+        const auto r = representative(flatten(id));
+        return ImageID(r / _div_x, r % _div_x, id.orientation());
+    }
+
+
+    /// `MoveOptimizer::setTileClasses`に渡せる、各断片の代表の番号の表です
+    std::vector<uint16_t> canonicalTiles() const
+    {
+        std::vector<uint16_t> dst(size());
+        for(auto k: iota(size()))
+            dst[k] = static_cast<uint16_t>(representative(k));
+
+        return dst;
+    }
+
+
+    /// 全ての断片をクラスタの代表に置き換えた配置を返します
+    template <typename A>
+    BasicArrangement<A> canonicalize(BasicArrangement<A> const & arr) const
+    {
+        BasicArrangement<A> dst = arr;
+        for(auto k: iota(dst.size()))
+            dst.data()[k] = canonical(dst.data()[k]);
+
+        return dst;
+    }
+
+
+    /** 配置のZobristハッシュを、同じクラスタの断片を同一視して計算します。
+    同じクラスタの断片を入れ替えただけの配置は、同じハッシュになります。
+    */
+    template <typename A>
+    uint64_t hash(BasicArrangement<A> const & arr) const
+    {
+        uint64_t h = 0;
+        for(auto k: iota(arr.size()))
+            h ^= cellKey(k, arr.data()[k]);
+
+        return h;
+    }
+
+
+    /** 位置kに断片idがあることを表すZobristハッシュの要素です。
+    2つの位置の断片を交換したときは、前後の要素4つをxorすればハッシュを差分更新できます。
+    */
+    uint64_t cellKey(std::size_t k, ImageID id) const
+    {
+        return mix64((static_cast<uint64_t>(k) << 24) | (static_cast<uint64_t>(id.orientation()) << 16) | _cluster[flatten(id)]);
+    }
+
+
+  private:
+    typedef std::array<uint32_t, 15> Signature;     // 全体、右、上、左、下の、BGRごとの画素値の和
+    typedef std::array<int64_t, 15> Key;
+
+    std::size_t _div_x;
+    std::size_t _div_y;
+    std::size_t _ww;
+    std::size_t _hh;
+    std::vector<std::size_t> _cluster;
+    std::vector<std::vector<std::size_t>> _members;
+
+
+    std::size_t flatten(ImageID id) const { return id.get_position().flatten(_div_x); }
+
+
+    static Signature signature(ImageView e)
+    {
+        Signature s = {};
+        const std::size_t hh = e.height(),
+                          ww = e.width();
+
+        for(std::size_t y = 0; y < hh; ++y){
+            const uint8_t* p = e.row(y);
+            for(std::size_t x = 0; x < ww; ++x)
+                for(std::size_t ch = 0; ch < 3; ++ch){
+                    const uint8_t v = p[x * 3 + ch];
+                    s[ch] += v;
+                    if(x == ww - 1) s[3 + ch] += v;
+                    if(y == 0)      s[6 + ch] += v;
+                    if(x == 0)      s[9 + ch] += v;
+                    if(y == hh - 1) s[12 + ch] += v;
+                }
+        }
+
+        return s;
+    }
+
+
+    /// 画素値の和から、平均を`step`で量子化した値を作ります。`step`が0なら和そのものを使います。
+    Key quantize(Signature const & s, double step) const
+    {
+        Key dst;
+        for(std::size_t i = 0; i < s.size(); ++i){
+            if(step == 0){
+                dst[i] = s[i];
+                continue;
+            }
+
+            dst[i] = static_cast<int64_t>(std::floor(s[i] / (step * divisor(i))));
+        }
+
+        return dst;
+    }
+
+
+    /// 2つの断片の1画素あたりの二乗誤差が`tolerance`以下かどうか
+    static bool similar(ImageView a, ImageView b, float tolerance)
+    {
+        const std::size_t hh = a.height(),
+                          len = a.width() * 3;
+
+        if(tolerance == 0){
+            for(std::size_t y = 0; y < hh; ++y)
+                if(std::memcmp(a.row(y), b.row(y), len) != 0)
+                    return false;
+
+            return true;
+        }
+
+        const double limit = static_cast<double>(tolerance) * hh * a.width();
+        uint64_t sum = 0;
+        for(std::size_t y = 0; y < hh; ++y){
+            const uint8_t *p = a.row(y), *q = b.row(y);
+            for(std::size_t x = 0; x < len; ++x){
+                const int diff = int(p[x]) - int(q[x]);
+                sum += diff * diff;
+            }
+
+            if(sum > limit)
+                return false;
+        }
+
+        return true;
+    }
+
+
+    /// シグネチャのi番目の要素が、何画素の和か
+    std::size_t divisor(std::size_t i) const
+    {
+        return i < 3 ? _ww * _hh : (((i / 3) & 1) ? _hh : _ww);
+    }
+};
+
+}} // namespace procon::utils
@@ -6,15 +6,19 @@
 #include <iostream>
 #include <type_traits>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <fstream>
 #include <boost/optional.hpp>
 #include <algorithm>
+#include <thread>
+#include <vector>
 #include "constants.hpp"
 #include "template.hpp"
 #include "types.hpp"
 #include "range.hpp"
 #include "dwrite.hpp"
+#include "thread_pool.hpp"
 
 namespace procon { namespace utils {
 
@@ -43,7 +47,7 @@ PROCON_DEF_TYPE_TRAIT(is_image, true,
     identity<size_t>(p->height()),
     identity<size_t>(p->width()),
     identity<Pixel>(p->get_pixel(0u, 0u)),
-    identity<typename std::remove_const<T>::type>(p->clone())
+    identity(p->clone())
 ));
 #endif
 
@@ -75,6 +79,9 @@ PROCON_DEF_TYPE_TRAIT(is_divided_image, is_image<T>(),
 実際には、保持している情報は、Index2Dと同じで、グチャグチャの画像中での断片の位置です。
 
 この変更により、`std::map<ImageID, Index2D>`というように型から意味を完全に把握できるようになりました。
+
+断片を回転・反転して置く問題のために、ImageIDは断片の向き(`Orientation`)も持ちます。
+向きが異なれば異なるImageIDとして比較されます。向きを除いた断片そのものは`upright()`で得られます。
 */
 struct ImageID
 {
@@ -84,13 +91,21 @@ struct ImageID
     : ImageID(idx[0], idx[1]) {}
 
 
-    ImageID(size_t r, size_t c)
+    explicit ImageID(utils::Position pos, Orientation o = Orientation::upright)
+    : ImageID(pos.row(), pos.col(), o) {}
+
+
+    ImageID(size_t r, size_t c, Orientation o = Orientation::upright)
     {
         _val[0] = r & 0xFF;
         _val[1] = c & 0xFF;
+        _val[2] = static_cast<uint8_t>(o);
     }
 
 
+    /** 元の向きの断片を返します。
+    向きを反映した画素は`SwappedImage`の`element_row`や`get_pixel`で得られます。
+    */
     template <typename DivImgType>
     auto get_image(DivImgType & img) const
     -> std::enable_if_t<is_divided_image<DivImgType>(), decltype(img.get_element(0, 0))>
@@ -105,10 +120,27 @@ struct ImageID
     }
 
 
+    utils::Position get_position() const
+    {
+        return utils::Position(_val[0], _val[1]);
+    }
+
+
+    Orientation orientation() const { return static_cast<Orientation>(_val[2]); }
+
+
+    /// 向きを元に戻したImageIDを返します
+    ImageID upright() const { return ImageID(_val[0], _val[1]); }
+
+
+    /// 同じ断片を向き`o`で置いたImageIDを返します
+    ImageID oriented(Orientation o) const { return ImageID(_val[0], _val[1], o); }
+
+
     bool operator==(ImageID const & other) const
     {
-        const auto v1 = this->get_uint16_t();
-        const auto v2 = other.get_uint16_t();
+        const auto v1 = this->get_uint32_t();
+        const auto v2 = other.get_uint32_t();
         return v1 == v2;
     }
 
@@ -121,8 +153,8 @@ struct ImageID
 
     int opCmp(ImageID const & other) const
     {
-        const auto v1 = this->get_uint16_t();
-        const auto v2 = other.get_uint16_t();
+        const auto v1 = this->get_uint32_t();
+        const auto v2 = other.get_uint32_t();
 
         if(v1 < v2)
             return -1;
@@ -159,25 +191,36 @@ struct ImageID
 
     size_t get_hash() const
     {
-        return std::hash<uint16_t>()(get_uint16_t());
+        return std::hash<uint32_t>()(get_uint32_t());
     }
 
 
     void to_string(std::ostream& s) const
     {
-        // 16進数で xy の順番で出力
-        s << std::hex << static_cast<size_t>(_val[1]) << std::hex << static_cast<size_t>(_val[0]);
+        // 16進数で xy の順番で出力 (16以上を含む場合は xxyy)、向きがあれば"@向き"を続ける
+        s << encodeAnswerPosition(get_position());
+        if(orientation() != Orientation::upright)
+            s << "@" << static_cast<int>(_val[2]);
     }
 
 
   private:
-    uint8_t _val[2];     // 8bit*2
+    uint8_t _val[3];     // 行, 列, 向き
 
 
-    uint16_t get_uint16_t() const { return (static_cast<uint16_t>(_val[0]) << 8) | _val[1]; }
+    uint32_t get_uint32_t() const { return (static_cast<uint32_t>(_val[0]) << 16) | (static_cast<uint32_t>(_val[1]) << 8) | _val[2]; }
 };
 
 
+// どちらも比較の上位の桁から順に8bitずつ (行, 列[, 向き]) 並んでいるので、バイト列の辞書順と大小関係が一致する
+template <> struct is_bytewise_comparable<ImageID> : std::true_type {};
+template <> struct is_bytewise_comparable<Position> : std::true_type {};
+
+
+class ImageView;
+class DividedImageView;
+
+
 template <typename T> constexpr bool isCVMat(){ return std::is_same<cv::Mat, T>::value; }
 template <typename T> constexpr bool isConstCVMat(){ return std::is_same<const cv::Mat, T>::value; }
 
@@ -222,6 +265,10 @@ class Image
     }
 
 
+    /// 参照カウントを持たない読み込み専用のビューを返します
+    ImageView view() const;
+
+
   private:
     cv::Mat _img;
 };
@@ -245,6 +292,74 @@ const Image> makeImage(const CVMat && img)
 }
 
 
+/** 8bit 3チャンネル(BGR)の画像の、参照カウントを持たない読み込み専用のビューです。
+`Image`と異なり、コピーしてもアトミックな参照カウントの操作は起きません。
+ビューは元の画像より長生きしてはいけません。
+画素を書き換えたり、元の画像と独立した画像が必要な場合には`clone`で`Image`を作ってください。
+
+Example:
+------------
+void f(ImageView img)       // 値渡しでも安い
+{
+    for(auto y: iota(img.height()))
+        for(auto x: iota(img.width()))
+            sum += img.get_pixel(y, x).r();
+}
+
+f(pb.get_element(0, 0));    // Imageからは暗黙に変換できる
+------------
+*/
+class ImageView
+{
+  public:
+    ImageView() : _data(nullptr), _rows(0), _cols(0), _step(0) {}
+
+    ImageView(const uint8_t* data, std::size_t rows, std::size_t cols, std::size_t step)
+    : _data(data), _rows(rows), _cols(cols), _step(step) {}
+
+    ImageView(cv::Mat const & mat)
+    : ImageView(mat.data, mat.rows, mat.cols, static_cast<std::size_t>(mat.step)) {}
+
+    ImageView(Image const & img)
+    : ImageView(img.cvMat()) {}
+
+
+    std::size_t height() const { return _rows; }
+    std::size_t width() const { return _cols; }
+    std::size_t step() const { return _step; }
+
+    /// y行目の先頭のピクセルへのポインタを返します
+    const uint8_t* row(std::size_t y) const { return _data + y * _step; }
+
+    Pixel get_pixel(std::size_t y, std::size_t x) const { return Pixel(*reinterpret_cast<const cv::Vec3b*>(row(y) + x * 3)); }
+
+
+    /// (y, x)を左上とする h * w の部分画像のビューを返します
+    ImageView roi(std::size_t y, std::size_t x, std::size_t h, std::size_t w) const
+    {
+        return ImageView(row(y) + x * 3, h, w, _step);
+    }
+
+
+    /// 参照カウントを持たない`cv::Mat`のヘッダを返します
+    const cv::Mat cvMat() const
+    {
+        return cv::Mat(static_cast<int>(_rows), static_cast<int>(_cols), CV_8UC3, const_cast<uint8_t*>(_data), _step);
+    }
+
+
+    /// 画素をコピーした`Image`を返します
+    Image clone() const { return Image(cvMat().clone()); }
+
+
+  private:
+    const uint8_t* _data;
+    std::size_t _rows;
+    std::size_t _cols;
+    std::size_t _step;
+};
+
+
 class DividedImage
 {
   public:
@@ -265,7 +380,10 @@ class DividedImage
     >
     DividedImage(T && m, std::size_t div_x, std::size_t div_y)
     : _master(std::forward<T>(m)), _div_x(div_x), _div_y(div_y)
-    {}
+    {
+        PROCON_ENFORCE(div_x <= maxDivision && div_y <= maxDivision,
+            format("too many divisions: % x %", div_x, div_y));
+    }
 
 
     /// 問題画像の高さを返します
@@ -328,6 +446,10 @@ class DividedImage
     }
 
 
+    /// 参照カウントを持たない読み込み専用のビューを返します
+    DividedImageView view() const;
+
+
     template <typename T, typename F>
     static std::enable_if_t<is_divided_image<T>(),
     void> foreach(T const & pb, F f)
@@ -338,6 +460,58 @@ class DividedImage
     }
 
 
+    /** `foreach`の並列版です。
+    既定のスレッドプール(`defaultThreadPool()`)で、呼び出し元を含めて高々`nThreads`スレッドで処理します。
+    断片を行優先で並べた順に、空いたスレッドが次の断片を取っていきます。
+    `f`は異なる(i, j)について同時に呼ばれるので、スレッド安全である必要があります。
+    `f`が例外を投げた場合は残りの断片の処理を打ち切り、処理中の断片が全て終わってから最初の例外を投げなおします。
+    */
+    template <typename T, typename F>
+    static std::enable_if_t<is_divided_image<T>(),
+    void> parallel_foreach(T const & pb, F f, std::size_t nThreads = std::thread::hardware_concurrency())
+    {
+        const std::size_t cols = pb.div_x(),
+                          n = pb.div_y() * cols;
+
+        nThreads = std::min(std::max<std::size_t>(nThreads, 1), n);
+        if(nThreads <= 1){
+            foreach(pb, f);
+            return;
+        }
+
+        defaultThreadPool().parallel_for(grid_range(pb.div_y(), cols), f, nThreads);
+    }
+
+
+    /** 各断片について`f(i, j)`を並列に計算し、その結果を行優先の順に`op`で畳み込みます。
+    畳み込みは呼び出し元のスレッドで順番に行うので、浮動小数点数の和などでも結果はスレッド数によりません。
+
+    Example:
+    ------------
+    // 各断片の左上のピクセルの赤成分の和
+    auto sum = DividedImage::parallel_reduce(pb, std::size_t(0),
+        [&](std::size_t i, std::size_t j){ return pb.get_element(i, j).get_pixel(0, 0).r(); },
+        [](std::size_t a, std::size_t b){ return a + b; });
+    ------------
+    */
+    template <typename T, typename R, typename F, typename Op>
+    static std::enable_if_t<is_divided_image<T>(),
+    R> parallel_reduce(T const & pb, R init, F f, Op op, std::size_t nThreads = std::thread::hardware_concurrency())
+    {
+        const std::size_t cols = pb.div_x();
+        std::vector<boost::optional<R>> rs(pb.div_y() * cols);
+
+        parallel_foreach(pb, [&](std::size_t i, std::size_t j){
+            rs[i * cols + j] = f(i, j);
+        }, nThreads);
+
+        for(auto& r: rs)
+            init = op(std::move(init), std::move(*r));
+
+        return init;
+    }
+
+
   private:
     Image _master;
     std::size_t _div_x;
@@ -369,6 +543,58 @@ const DividedImage makeDividedImage(const T && img, std::size_t div_x, std::size
 
 
 
+/** `DividedImage`の、参照カウントを持たない読み込み専用のビューです。
+断片を取り出す`get_element`も`ImageView`を返すので、`cv::Mat`のヘッダを作りません。
+*/
+class DividedImageView
+{
+  public:
+    DividedImageView(ImageView master, std::size_t div_x, std::size_t div_y)
+    : _master(master), _div_x(div_x), _div_y(div_y) {}
+
+    DividedImageView(DividedImage const & img)
+    : DividedImageView(ImageView(img.cvMat()), img.div_x(), img.div_y()) {}
+
+
+    std::size_t height() const { return _master.height(); }
+    std::size_t width() const { return _master.width(); }
+    Pixel get_pixel(std::size_t y, std::size_t x) const { return _master.get_pixel(y, x); }
+    std::size_t div_x() const { return _div_x; }
+    std::size_t div_y() const { return _div_y; }
+
+
+    /// インデックス配列におけるi行j列の断片のビューを返します
+    ImageView get_element(std::size_t r, std::size_t c) const
+    {
+        const auto ww = width() / div_x(),
+                   hh = height() / div_y();
+
+        return _master.roi(r * hh, c * ww, hh, ww);
+    }
+
+
+    ImageView get_element(ImageID id) const { return id.get_image(*this); }
+
+
+    ImageView master() const { return _master; }
+    const cv::Mat cvMat() const { return _master.cvMat(); }
+
+
+    /// 画素をコピーした`DividedImage`を返します
+    DividedImage clone() const { return DividedImage(_master.clone(), _div_x, _div_y); }
+
+
+  private:
+    ImageView _master;
+    std::size_t _div_x;
+    std::size_t _div_y;
+};
+
+
+inline ImageView Image::view() const { return ImageView(*this); }
+inline DividedImageView DividedImage::view() const { return DividedImageView(*this); }
+
+
 /** 問題の各種定数と画像を管理する型です。
 */
 class Problem
@@ -515,6 +741,10 @@ class Problem
     const DividedImage dividedImage() const { return _master; }
 
 
+    /// 参照カウントを持たない読み込み専用のビューを返します
+    DividedImageView view() const { return _master.view(); }
+
+
   private:
     DividedImage _master;
     int _change_cost;
@@ -555,15 +785,27 @@ class SwappedImage
     }
 
 
+    /** 断片を並べ替えた画像を新しく作って返します。
+    元の画像全体を複製してから上書きするのではなく、断片の行ごとに直接コピーします。
+    回転・反転した断片は、その向きに並べ替えた画素を書き込みます。
+    */
     cv::Mat cvMat() const
     {
-        auto cln = _master.clone();
+        const auto ww = width() / div_x(),
+                   hh = height() / div_y();
+
+        // 分割数で割り切れない場合の端の部分は元の画像のまま
+        cv::Mat dst = (ww * div_x() == width() && hh * div_y() == height())
+                    ? cv::Mat(static_cast<int>(height()), static_cast<int>(width()), CV_8UC3)
+                    : _master.cvMat().clone();
 
-        DividedImage::foreach(_master, [&](std::size_t i, std::size_t j){
-            get_element(i, j).cvMat().copyTo(cln.get_element(i, j).cvMat());
+        // 断片ごとにコピー先の領域が異なるので並列に処理できる
+        DividedImage::parallel_foreach(_master, [&](std::size_t i, std::size_t j){
+            for(std::size_t y = 0; y < hh; ++y)
+                element_row(i, j, y, dst.ptr<uint8_t>(static_cast<int>(i * hh + y)) + j * ww * 3);
         });
 
-        return cln.cvMat();
+        return dst;
     }
 
 
@@ -573,12 +815,14 @@ class SwappedImage
     size_t div_y() const { return _master.div_y(); }
     Pixel get_pixel(std::size_t r, std::size_t c) const
     {
-        const auto i = r / _master.div_y(),
-                   j = c / _master.div_x(),
-                   remI = r % _master.div_y(),
-                   remJ = c % _master.div_x();
-        
-        return this->get_element(i, j).get_pixel(remI, remJ);
+        const auto hh = height() / div_y(),
+                   ww = width() / div_x();
+
+        const auto id = _idx[r / hh][c / ww];
+        PROCON_ENFORCE(!swapsAxes(id.orientation()) || hh == ww, "fragments must be square to be rotated by 90 degrees");
+
+        const auto p = orientedSource(id.orientation(), r % hh, c % ww, hh, ww);
+        return _master.view().get_element(id).get_pixel(p[0], p[1]);
     }
 
     Image get_element(std::size_t r, std::size_t c)
@@ -593,6 +837,37 @@ class SwappedImage
     }
 
 
+    /// i行j列にある断片の、参照カウントを持たないビューを返します。断片の向きは反映されません。
+    ImageView element_view(std::size_t r, std::size_t c) const
+    {
+        return _master.view().get_element(_idx[r][c]);
+    }
+
+
+    /** i行j列にある断片を、その向きで置いたときのy行目の画素(BGR)を`dst`に書き込みます。
+    向きが`upright`なら1回の`memcpy`です。90度回転する場合は断片が正方形である必要があります。
+    */
+    void element_row(std::size_t r, std::size_t c, std::size_t y, uint8_t* dst) const
+    {
+        const auto id = _idx[r][c];
+        const auto e = _master.view().get_element(id);
+        const auto o = id.orientation();
+        const std::size_t hh = e.height(),
+                          ww = e.width();
+
+        if(o == Orientation::upright){
+            std::memcpy(dst, e.row(y), ww * 3);
+            return;
+        }
+
+        PROCON_ENFORCE(!swapsAxes(o) || hh == ww, "fragments must be square to be rotated by 90 degrees");
+        for(std::size_t x = 0; x < ww; ++x){
+            const auto p = orientedSource(o, y, x, hh, ww);
+            std::memcpy(dst + x * 3, e.row(p[0]) + p[1] * 3, 3);
+        }
+    }
+
+
     SwappedImage clone() const
     {
         SwappedImage dst(_master.clone(), _idx);
@@ -0,0 +1,455 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "image.hpp"
+#include "exception.hpp"
+#include "dwrite.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 存在するキーを表すビット集合です。`ImageIDMap`と`ImageIDSet`で共有します。
+*/
+class DenseBitset
+{
+  public:
+    DenseBitset() : _count(0) {}
+    explicit DenseBitset(std::size_t n) : _bits((n + 63) / 64, 0), _count(0) {}
+
+
+    bool test(std::size_t i) const { return (_bits[i >> 6] >> (i & 63)) & 1; }
+
+
+    /// ビットを立てます。既に立っていた場合はfalseを返します。
+    bool set(std::size_t i)
+    {
+        const uint64_t m = uint64_t(1) << (i & 63);
+        const bool added = !(_bits[i >> 6] & m);
+        _bits[i >> 6] |= m;
+        _count += added;
+        return added;
+    }
+
+
+    /// ビットを下ろします。立っていなかった場合はfalseを返します。
+    bool reset(std::size_t i)
+    {
+        const uint64_t m = uint64_t(1) << (i & 63);
+        const bool removed = (_bits[i >> 6] & m) != 0;
+        _bits[i >> 6] &= ~m;
+        _count -= removed;
+        return removed;
+    }
+
+
+    void clear()
+    {
+        std::fill(_bits.begin(), _bits.end(), 0);
+        _count = 0;
+    }
+
+
+    std::size_t count() const { return _count; }
+    std::size_t capacity() const { return _bits.size() * 64; }
+
+
+    /// i番目以降で最初に立っているビットの位置を返します。無ければ`capacity()`を返します。
+    std::size_t next(std::size_t i) const
+    {
+        std::size_t w = i >> 6;
+        if(w >= _bits.size()) return capacity();
+
+        uint64_t bits = _bits[w] & (~uint64_t(0) << (i & 63));
+        while(bits == 0){
+            if(++w == _bits.size()) return capacity();
+            bits = _bits[w];
+        }
+
+        return w * 64 + countTrailingZeros(bits);
+    }
+
+
+  private:
+    std::vector<uint64_t> _bits;
+    std::size_t _count;
+
+
+    static std::size_t countTrailingZeros(uint64_t v)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(v);
+#else
+        std::size_t n = 0;
+        while(!(v & 1)){ v >>= 1; ++n; }
+        return n;
+#endif
+    }
+};
+
+
+/** `ImageID`をキーとする、ノードを持たない平坦な連想配列です。
+`std::map<ImageID, T>`や`std::unordered_map<ImageID, T>`の代わりに使えるよう、同じような名前のメンバを持ちます。
+
++ `ImageIDMap<T>(div_x, div_y)`    断片の密なインデックス (r * div_x + c) を添字とします
++ `ImageIDMap<T>()`                パックした16bitの値 (r << 8 | c) を添字とします
+
+どちらも向き(`ImageID::orientation`)ごとに別の要素を持つので、添字は(位置の添字 * `numOrientations` + 向き)です。
+キーの検索は配列の添字アクセス1回で、要素の存在はビット集合で管理します。
+Tはデフォルト構築可能である必要があります。イテレータはキーの昇順に要素をたどります。
+
+Example:
+------------
+ImageIDMap<Index2D> pos(pb.div_x(), pb.div_y());
+DividedImage::foreach(pb, [&](size_t i, size_t j){
+    pos[idx[i][j]] = makeIndex2D(i, j);
+});
+
+for(auto& e: pos)
+    writeln(e.first, " -> ", e.second);
+------------
+*/
+template <typename T>
+class ImageIDMap
+{
+  public:
+    typedef ImageID key_type;
+    typedef T mapped_type;
+    typedef std::pair<const ImageID, T> value_type;
+    typedef std::size_t size_type;
+
+
+    template <typename V, typename Map>
+    struct Iterator
+    {
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const ImageID, T> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        Iterator(Map* map, std::size_t i) : _map(map), _i(i) {}
+
+        // iteratorからconst_iteratorへの変換
+        template <typename V2, typename Map2>
+        Iterator(Iterator<V2, Map2> const & it) : _map(it._map), _i(it._i) {}
+
+        V& operator*() const { return _map->_slots[_i]; }
+        V* operator->() const { return &_map->_slots[_i]; }
+
+        Iterator& operator++()
+        {
+            _i = _map->nextIndex(_i + 1);
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            auto dst = *this;
+            ++*this;
+            return dst;
+        }
+
+        bool operator==(Iterator const & other) const { return _i == other._i; }
+        bool operator!=(Iterator const & other) const { return _i != other._i; }
+
+      private:
+        Map* _map;
+        std::size_t _i;
+
+        template <typename V2, typename Map2> friend struct Iterator;
+        friend class ImageIDMap;
+    };
+
+    typedef Iterator<value_type, ImageIDMap> iterator;
+    typedef Iterator<const value_type, const ImageIDMap> const_iterator;
+
+
+    /// パックした16bitの値を添字とする
+    ImageIDMap() : ImageIDMap(256, 256, 256) {}
+
+
+    /// 横 div_x, 縦 div_y の断片の密なインデックスを添字とする
+    ImageIDMap(std::size_t div_x, std::size_t div_y) : ImageIDMap(div_x, div_y, div_x) {}
+
+
+    ImageIDMap(ImageIDMap const & other) = default;
+    ImageIDMap(ImageIDMap&& other) = default;
+
+
+    // キーがconstなので、要素の代入ではなく丸ごと交換する
+    ImageIDMap& operator=(ImageIDMap other)
+    {
+        swap(other);
+        return *this;
+    }
+
+
+    void swap(ImageIDMap& other)
+    {
+        std::swap(_stride, other._stride);
+        _slots.swap(other._slots);
+        std::swap(_present, other._present);
+    }
+
+
+    /** 要素が無ければデフォルト構築した要素を追加して、その参照を返します。
+    `std::vector`と同様に範囲外のキーは検査しないので、必要なら`at`か`emplace`を使ってください。
+    */
+    T& operator[](ImageID id)
+    {
+        const auto i = index(id);
+        _present.set(i);
+        return _slots[i].second;
+    }
+
+
+    /// 要素が無い場合には例外を投げます
+    T& at(ImageID id)
+    {
+        const auto i = checkedIndex(id);
+        PROCON_ENFORCE(_present.test(i), format("ImageIDMap: key % is not found", id));
+        return _slots[i].second;
+    }
+
+
+    /// ditto
+    T const & at(ImageID id) const
+    {
+        const auto i = checkedIndex(id);
+        PROCON_ENFORCE(_present.test(i), format("ImageIDMap: key % is not found", id));
+        return _slots[i].second;
+    }
+
+
+    bool contains(ImageID id) const
+    {
+        const auto i = index(id);
+        return id.get_position().col() < _stride && i < _slots.size() && _present.test(i);
+    }
+
+
+    std::size_t count(ImageID id) const { return contains(id) ? 1 : 0; }
+
+
+    iterator find(ImageID id) { return contains(id) ? iterator(this, index(id)) : end(); }
+    const_iterator find(ImageID id) const { return contains(id) ? const_iterator(this, index(id)) : end(); }
+
+
+    std::pair<iterator, bool> insert(value_type const & v) { return emplace(v.first, v.second); }
+
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(ImageID id, Args&&... args)
+    {
+        const auto i = checkedIndex(id);
+        const bool added = _present.set(i);
+        if(added)
+            _slots[i].second = T(std::forward<Args>(args)...);
+
+        return std::make_pair(iterator(this, i), added);
+    }
+
+
+    std::size_t erase(ImageID id)
+    {
+        if(!contains(id))
+            return 0;
+
+        const auto i = index(id);
+        _present.reset(i);
+        _slots[i].second = T();
+        return 1;
+    }
+
+
+    void clear()
+    {
+        for(auto& e: *this)
+            e.second = T();
+
+        _present.clear();
+    }
+
+
+    std::size_t size() const { return _present.count(); }
+    bool empty() const { return size() == 0; }
+
+
+    iterator begin() { return iterator(this, nextIndex(0)); }
+    iterator end() { return iterator(this, _slots.size()); }
+    const_iterator begin() const { return const_iterator(this, nextIndex(0)); }
+    const_iterator end() const { return const_iterator(this, _slots.size()); }
+
+
+  private:
+    std::size_t _stride;
+    std::vector<value_type> _slots;
+    DenseBitset _present;
+
+
+    ImageIDMap(std::size_t w, std::size_t h, std::size_t stride)
+    : _stride(stride), _present(w * h * numOrientations)
+    {
+        _slots.reserve(w * h * numOrientations);
+        for(std::size_t r = 0; r < h; ++r)
+            for(std::size_t c = 0; c < w; ++c)
+                for(std::size_t o = 0; o < numOrientations; ++o)
+                    _slots.emplace_back(std::piecewise_construct,
+                        std::forward_as_tuple(r, c, static_cast<Orientation>(o)), std::forward_as_tuple());
+    }
+
+
+    std::size_t index(ImageID id) const
+    {
+        const auto p = id.get_position();
+        return (p.row() * _stride + p.col()) * numOrientations + static_cast<std::size_t>(id.orientation());
+    }
+
+
+    std::size_t checkedIndex(ImageID id) const
+    {
+        const auto p = id.get_position();
+        PROCON_ENFORCE(p.col() < _stride && index(id) < _slots.size(), format("ImageIDMap: key % is out of range", id));
+        return index(id);
+    }
+
+
+    std::size_t nextIndex(std::size_t i) const
+    {
+        return std::min(_present.next(i), _slots.size());
+    }
+};
+
+
+/** `ImageID`の集合を、ビット集合で表したものです。
+`ImageIDMap`と同様に、断片の密なインデックスか、パックした16bitの値に向きを加えたものを添字とします。
+
+Example:
+------------
+ImageIDSet used(pb.div_x(), pb.div_y());
+used.insert(ImageID(0, 1));
+
+if(used.count(ImageID(0, 1)))
+    ...
+------------
+*/
+class ImageIDSet
+{
+  public:
+    typedef ImageID key_type;
+    typedef ImageID value_type;
+    typedef std::size_t size_type;
+
+
+    struct const_iterator
+    {
+        typedef std::forward_iterator_tag iterator_category;
+        typedef ImageID value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const ImageID* pointer;
+        typedef ImageID reference;
+
+        const_iterator(ImageIDSet const * set, std::size_t i) : _set(set), _i(i) {}
+
+        ImageID operator*() const { return _set->keyOf(_i); }
+
+        const_iterator& operator++()
+        {
+            _i = _set->nextIndex(_i + 1);
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            auto dst = *this;
+            ++*this;
+            return dst;
+        }
+
+        bool operator==(const_iterator const & other) const { return _i == other._i; }
+        bool operator!=(const_iterator const & other) const { return _i != other._i; }
+
+      private:
+        ImageIDSet const * _set;
+        std::size_t _i;
+    };
+
+    typedef const_iterator iterator;
+
+
+    /// パックした16bitの値を添字とする
+    ImageIDSet() : _stride(256), _capacity(256 * 256 * numOrientations), _present(_capacity) {}
+
+
+    /// 横 div_x, 縦 div_y の断片の密なインデックスを添字とする
+    ImageIDSet(std::size_t div_x, std::size_t div_y) : _stride(div_x), _capacity(div_x * div_y * numOrientations), _present(_capacity) {}
+
+
+    /// 追加した場合はtrueを返します
+    std::pair<const_iterator, bool> insert(ImageID id)
+    {
+        const auto i = checkedIndex(id);
+        return std::make_pair(const_iterator(this, i), _present.set(i));
+    }
+
+
+    std::size_t erase(ImageID id) { return contains(id) ? _present.reset(index(id)) : 0; }
+
+
+    bool contains(ImageID id) const
+    {
+        const auto i = index(id);
+        return id.get_position().col() < _stride && i < _capacity && _present.test(i);
+    }
+
+
+    std::size_t count(ImageID id) const { return contains(id) ? 1 : 0; }
+    const_iterator find(ImageID id) const { return contains(id) ? const_iterator(this, index(id)) : end(); }
+
+
+    void clear() { _present.clear(); }
+    std::size_t size() const { return _present.count(); }
+    bool empty() const { return size() == 0; }
+
+
+    const_iterator begin() const { return const_iterator(this, nextIndex(0)); }
+    const_iterator end() const { return const_iterator(this, _capacity); }
+
+
+  private:
+    std::size_t _stride;
+    std::size_t _capacity;
+    DenseBitset _present;
+
+
+    std::size_t index(ImageID id) const
+    {
+        const auto p = id.get_position();
+        return (p.row() * _stride + p.col()) * numOrientations + static_cast<std::size_t>(id.orientation());
+    }
+
+
+    std::size_t checkedIndex(ImageID id) const
+    {
+        PROCON_ENFORCE(id.get_position().col() < _stride && index(id) < _capacity, format("ImageIDSet: key % is out of range", id));
+        return index(id);
+    }
+
+
+    ImageID keyOf(std::size_t i) const
+    {
+        const std::size_t pos = i / numOrientations;
+        return ImageID(pos / _stride, pos % _stride, static_cast<Orientation>(i % numOrientations));
+    }
+
+
+    std::size_t nextIndex(std::size_t i) const { return std::min(_present.next(i), _capacity); }
+};
+
+}} // namespace procon::utils
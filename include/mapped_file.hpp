@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "constants.hpp"
+#include "exception.hpp"
+#include "dwrite.hpp"
+
+#if defined(TARGET_LINUX) || defined(TARGET_OSX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace procon { namespace utils {
+
+/** 読み込み専用でファイルをメモリにマップします。
+mmapが使えない環境では、ファイル全体をメモリに読み込みます。
+
+Example:
+------------
+MappedFile file("pdb.bin");
+const uint8_t* p = file.data();
+for(auto i: iota(file.size()))
+    ...
+------------
+*/
+class MappedFile
+{
+  public:
+    MappedFile() : _data(nullptr), _size(0) {}
+
+
+    /// ファイルを開けない場合は例外を投げます
+    explicit MappedFile(std::string const & path)
+    : MappedFile()
+    {
+#if defined(TARGET_LINUX) || defined(TARGET_OSX)
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        PROCON_ENFORCE(fd >= 0, format("cannot open %", path));
+
+        struct stat st;
+        const bool statOK = ::fstat(fd, &st) == 0;
+        if(statOK && st.st_size > 0){
+            void* p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if(p != MAP_FAILED){
+                _data = static_cast<const uint8_t*>(p);
+                _size = st.st_size;
+            }
+        }
+        ::close(fd);
+
+        PROCON_ENFORCE(statOK, format("cannot stat %", path));
+        if(_data || st.st_size == 0)
+            return;
+#endif
+        std::ifstream ifs(path, std::ios::binary);
+        PROCON_ENFORCE(ifs, format("cannot open %", path));
+
+        _buf.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+        _data = reinterpret_cast<const uint8_t*>(_buf.data());
+        _size = _buf.size();
+    }
+
+
+    MappedFile(MappedFile&& other)
+    : MappedFile()
+    {
+        swap(other);
+    }
+
+
+    MappedFile& operator=(MappedFile&& other)
+    {
+        MappedFile tmp(std::move(other));
+        swap(tmp);
+        return *this;
+    }
+
+
+    ~MappedFile()
+    {
+#if defined(TARGET_LINUX) || defined(TARGET_OSX)
+        if(_data && _buf.empty())
+            ::munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+    }
+
+
+    const uint8_t* data() const { return _data; }
+    std::size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+
+    void swap(MappedFile& other)
+    {
+        // _bufがmoveされてもdata()の指す先は変わらない
+        std::swap(_data, other._data);
+        std::swap(_size, other._size);
+        _buf.swap(other._buf);
+    }
+
+
+  private:
+    const uint8_t* _data;
+    std::size_t _size;
+    std::vector<char> _buf;     // mmapできない場合のバッファ
+
+    MappedFile(MappedFile const &) = delete;
+    void operator=(MappedFile const &) = delete;
+};
+
+}} // namespace procon::utils
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "constants.hpp"
+#include "exception.hpp"
+
+#if defined(TARGET_LINUX)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace procon { namespace utils {
+
+/** 大きな読み込み専用の表や画像を、どのようなメモリに置くかの方針です。
+
++ `pages`        通常のページか、2MBのヒュージページか。
+                 `transparentHuge`はカーネルに透過的ヒュージページを使うよう助言し、
+                 `explicitHuge`は予約済みのヒュージページ(`MAP_HUGETLB`)を使います。
++ `placement`    NUMAノードへの配置。
+                 `firstTouch`は既定の動作(最初に書き込んだスレッドのノード)、
+                 `interleaved`は全てのノードにページ単位で分散、
+                 `replicated`はノードごとに複製を持ちます(`CostTable::forCurrentNode`を参照)。
+
+どの機能も、使えない環境(Linux以外、NUMAでない、ヒュージページが予約されていないなど)では黙って通常の確保に戻ります。
+*/
+struct MemoryPolicy
+{
+    enum class Pages : uint8_t { standard, transparentHuge, explicitHuge };
+    enum class Placement : uint8_t { firstTouch, interleaved, replicated };
+
+    Pages pages = Pages::standard;
+    Placement placement = Placement::firstTouch;
+
+
+    /// 全てのスレッドから読まれる表に向いた方針 (透過的ヒュージページ + インターリーブ)
+    static MemoryPolicy readMostly()
+    {
+        MemoryPolicy dst;
+        dst.pages = Pages::transparentHuge;
+        dst.placement = Placement::interleaved;
+        return dst;
+    }
+
+
+    /// 読み込み専用の表をノードごとに複製する方針
+    static MemoryPolicy replicatedReadMostly()
+    {
+        MemoryPolicy dst;
+        dst.pages = Pages::transparentHuge;
+        dst.placement = Placement::replicated;
+        return dst;
+    }
+};
+
+
+/// ヒュージページの大きさ
+constexpr std::size_t hugePageSize = std::size_t(2) << 20;
+
+
+/** NUMAノードの数を返します。NUMAでない環境やLinux以外では1です。
+*/
+inline std::size_t numaNodes()
+{
+    static const std::size_t n = [](){
+        std::size_t dst = 1;
+#if defined(TARGET_LINUX)
+        // "0-1"や"0,2-3"の形式
+        std::ifstream ifs("/sys/devices/system/node/online");
+        std::string s;
+        if(ifs >> s){
+            std::size_t last = 0, pos = 0;
+            while(pos < s.size()){
+                const std::size_t end = s.find_first_not_of("0123456789", pos);
+                if(end == pos) { ++pos; continue; }
+
+                last = std::max<std::size_t>(last, std::stoul(s.substr(pos, end - pos)));
+                pos = end == std::string::npos ? s.size() : end + 1;
+            }
+            dst = last + 1;
+        }
+#endif
+        return dst;
+    }();
+
+    return n;
+}
+
+
+/** 呼び出したスレッドが現在動いているNUMAノードを返します。分からない場合は0です。
+*/
+inline std::size_t currentNumaNode()
+{
+#if defined(TARGET_LINUX) && defined(SYS_getcpu)
+    unsigned cpu = 0, node = 0;
+    if(::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+        return std::min<std::size_t>(node, numaNodes() - 1);
+#endif
+    return 0;
+}
+
+
+namespace memory_policy_detail {
+
+#if defined(TARGET_LINUX)
+// <numaif.h>はlibnumaの開発パッケージが無いと使えないので、必要な定数だけ定義する
+constexpr int mpolPreferred = 1;
+constexpr int mpolInterleave = 3;
+constexpr unsigned mpolMfMove = 1u << 1;
+
+
+inline bool mbind(void* p, std::size_t bytes, int mode, std::size_t node, bool all, unsigned flags)
+{
+#if defined(SYS_mbind)
+    const std::size_t nodes = numaNodes();
+    if(nodes <= 1)
+        return false;
+
+    std::vector<unsigned long> mask((nodes + 63) / 64 + 1, 0);
+    for(std::size_t k = 0; k < nodes; ++k)
+        if(all || k == node)
+            mask[k / 64] |= 1ul << (k % 64);
+
+    return ::syscall(SYS_mbind, p, bytes, mode, mask.data(), mask.size() * 64, flags) == 0;
+#else
+    return false;
+#endif
+}
+
+
+/// [p, p + bytes)に含まれるページ境界に揃った範囲に方針を適用します
+inline void advise(void* p, std::size_t bytes, MemoryPolicy policy, std::size_t node, unsigned mbindFlags)
+{
+    const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = (reinterpret_cast<uintptr_t>(p) + page - 1) / page * page,
+                    end = (reinterpret_cast<uintptr_t>(p) + bytes) / page * page;
+    if(begin >= end)
+        return;
+
+    void* q = reinterpret_cast<void*>(begin);
+    const std::size_t len = end - begin;
+
+#if defined(MADV_HUGEPAGE)
+    if(policy.pages != MemoryPolicy::Pages::standard)
+        ::madvise(q, len, MADV_HUGEPAGE);
+#endif
+
+    if(policy.placement == MemoryPolicy::Placement::interleaved)
+        mbind(q, len, mpolInterleave, 0, true, mbindFlags);
+    else if(policy.placement == MemoryPolicy::Placement::replicated)
+        mbind(q, len, mpolPreferred, node, false, mbindFlags);
+}
+#endif
+
+} // namespace memory_policy_detail
+
+
+/** 方針に従って`bytes`バイトの領域を確保します。領域はゼロで初期化されています。
+`replicated`の場合は`node`のノードに置きます。
+mmapできない環境や失敗した場合は、通常の`new`で確保します。
+*/
+inline std::shared_ptr<uint8_t> allocateBuffer(std::size_t bytes, MemoryPolicy policy = MemoryPolicy(), std::size_t node = 0)
+{
+#if defined(TARGET_LINUX)
+    if(bytes != 0 && (policy.pages != MemoryPolicy::Pages::standard || policy.placement != MemoryPolicy::Placement::firstTouch)){
+        const bool huge = policy.pages != MemoryPolicy::Pages::standard;
+        const std::size_t len = huge ? (bytes + hugePageSize - 1) / hugePageSize * hugePageSize : bytes;
+
+        void* p = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+        if(policy.pages == MemoryPolicy::Pages::explicitHuge)
+            p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if(p == MAP_FAILED && huge){
+            // 透過的ヒュージページは2MBに揃った範囲にしか使われないので、余分に確保して先頭を揃え、前後の余りを返す
+            void* q = ::mmap(nullptr, len + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(q != MAP_FAILED){
+                const uintptr_t raw = reinterpret_cast<uintptr_t>(q),
+                                aligned = (raw + hugePageSize - 1) / hugePageSize * hugePageSize;
+                if(aligned != raw)
+                    ::munmap(q, aligned - raw);
+                if(aligned + len != raw + len + hugePageSize)
+                    ::munmap(reinterpret_cast<void*>(aligned + len), raw + hugePageSize - aligned);
+
+                p = reinterpret_cast<void*>(aligned);
+            }
+        }
+        if(p == MAP_FAILED)
+            p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if(p != MAP_FAILED){
+            // まだページに触れていないので、ここで決めた方針で最初の書き込み時に割り当てられる
+            memory_policy_detail::advise(p, len, policy, node, 0);
+            return std::shared_ptr<uint8_t>(static_cast<uint8_t*>(p), [len](uint8_t* q){ ::munmap(q, len); });
+        }
+    }
+#endif
+
+    return std::shared_ptr<uint8_t>(new uint8_t[std::max<std::size_t>(bytes, 1)](), std::default_delete<uint8_t[]>());
+}
+
+
+/// ditto
+template <typename T>
+std::shared_ptr<T> allocateArray(std::size_t n, MemoryPolicy policy = MemoryPolicy(), std::size_t node = 0)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+    auto buf = allocateBuffer(n * sizeof(T), policy, node);
+    return std::shared_ptr<T>(buf, reinterpret_cast<T*>(buf.get()));
+}
+
+
+/** 既に確保されている領域に方針を適用します。ページ境界に揃った内側の部分のみが対象です。
+既に割り当てられたページはノード間で移動されます。`replicated`は`interleaved`として扱います。
+*/
+inline void applyMemoryPolicy(const void* p, std::size_t bytes, MemoryPolicy policy)
+{
+#if defined(TARGET_LINUX)
+    if(policy.placement == MemoryPolicy::Placement::replicated)
+        policy.placement = MemoryPolicy::Placement::interleaved;
+
+    memory_policy_detail::advise(const_cast<void*>(p), bytes, policy, 0, memory_policy_detail::mpolMfMove);
+#else
+    (void)p; (void)bytes; (void)policy;
+#endif
+}
+
+
+/** `Image`や`DividedImage`の画素の領域に方針を適用します。
+OpenCVが確保した画像を確保しなおさずに、ヒュージページの助言やノード間の分散だけを後から行えます。
+*/
+template <typename Img>
+auto applyMemoryPolicy(Img const & img, MemoryPolicy policy)
+-> std::enable_if_t<std::is_reference<decltype(img.cvMat())>::value>
+{
+    auto const & m = img.cvMat();
+    applyMemoryPolicy(m.datastart, static_cast<std::size_t>(m.dataend - m.datastart), policy);
+}
+
+
+/** 読み込み専用の配列を、NUMAノードごとに複製します。
+NUMAでない環境では複製せず、元の配列を共有します。
+*/
+template <typename T>
+std::vector<std::shared_ptr<const T>> replicatePerNode(std::shared_ptr<const T> src, std::size_t n, MemoryPolicy policy)
+{
+    std::vector<std::shared_ptr<const T>> dst;
+    const std::size_t nodes = numaNodes();
+    if(nodes <= 1){
+        dst.push_back(std::move(src));
+        return dst;
+    }
+
+    policy.placement = MemoryPolicy::Placement::replicated;
+    for(std::size_t k = 0; k < nodes; ++k){
+        auto buf = allocateArray<T>(n, policy, k);
+        std::memcpy(buf.get(), src.get(), n * sizeof(T));
+        dst.push_back(std::move(buf));
+    }
+
+    return dst;
+}
+
+}} // namespace procon::utils
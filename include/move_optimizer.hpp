@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "image.hpp"
+#include "types.hpp"
+#include "answer.hpp"
+#include "arena.hpp"
+#include "exception.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 回答の交換操作列に対する覗き穴最適化を行います。
+
+次の3つの変形を、最終的な断片の配置を変えずに、回答が変化しなくなるまで繰り返します。
++ 逆操作の打ち消し (`UD`, `LR`など)
++ 同一状態(配置 + 選択位置)に戻る部分列の除去。状態はZobristハッシュで差分更新します。
++ 直前の選択の終了位置を選択しなおしている選択の結合と、空になった選択の除去
+
+交換操作は置換なので、部分列が恒等置換かどうかは初期配置に依存しません。
+このため、内部では恒等配置から始めて`SwappedImage`のインデックスと同様の平坦な配列を操作します。
+最後に元の回答と最適化後の回答の最終配置を比較し、万一ハッシュが衝突していた場合には逆操作の打ち消しのみの結果を返します。
+
+`setTileClasses`で見た目が同じ断片(`FragmentClusters`)を指定すると、それらを同一視した状態で部分列を除去するので、
+同じ断片どうしを入れ替えるだけの部分列も取り除けます。この場合、最終配置は同じクラスタの断片の入れ替えを除いて一致します。
+
+内部に作業領域を持つので、複数のスレッドから使う場合にはスレッドごとにオブジェクトを作ってください。
+
+Example:
+------------
+auto pb = *Problem::get("img1.ppm");
+MoveOptimizer opt(pb);
+
+Answer ans = readAnswer(std::cin);
+Answer better = opt.optimize(ans);
+writeAnswer(std::cout, better);
+------------
+*/
+class MoveOptimizer
+{
+  public:
+    MoveOptimizer(std::size_t div_x, std::size_t div_y, int select_cost, int change_cost)
+    : _div_x(div_x), _div_y(div_y), _select_cost(select_cost), _change_cost(change_cost), _moves(div_x, div_y)
+    {}
+
+
+    explicit MoveOptimizer(Problem const & pb)
+    : MoveOptimizer(pb.div_x(), pb.div_y(), pb.select_cost(), pb.change_cost())
+    {}
+
+
+    /** 回答を最適化します。
+    盤面の外に出る交換操作を含む場合は例外を投げます。
+    */
+    Answer optimize(Answer const & ans)
+    {
+        Answer cur;
+        cur.reserve(ans.size());
+        for(auto& op: ans){
+            Operation dst{op.select, cancelInversePairs(op.moves)};
+            cur.emplace_back(std::move(dst));
+        }
+        mergeSelections(cur);
+
+        // 逆操作の打ち消しと結合だけなら常に正しい
+        const Answer safe = cur;
+
+        while(1){
+            resetTiles();
+            for(auto& op: cur)
+                op.moves = removeCycles(op.select, op.moves);
+
+            const std::size_t n = cur.size();
+            mergeSelections(cur);
+
+            // 結合が起きなければ、新しく除去できる部分列は生まれない
+            if(cur.size() == n)
+                break;
+        }
+
+        if(!isSameArrangement(ans, cur))
+            return safe;
+
+        return cur;
+    }
+
+
+    /** 断片の同一視を指定します。`classes[k]`は断片kのクラスで、同じクラスの断片は区別しません。
+    空の配列を渡すと同一視をやめます。
+    */
+    void setTileClasses(std::vector<uint16_t> classes)
+    {
+        PROCON_ENFORCE(classes.empty() || classes.size() == _div_x * _div_y, "classes has invalid size");
+        _classes = std::move(classes);
+    }
+
+
+    /// 回答のコストを返します
+    std::size_t cost(Answer const & ans) const
+    {
+        return answerCost(ans, _select_cost, _change_cost);
+    }
+
+
+    /** 回答を恒等配置に適用した結果の配置を返します。
+    `result[r * div_x + c]`は、(r, c)にある断片の元の位置`r' * div_x + c'`です。
+    */
+    std::vector<uint16_t> arrangement(Answer const & ans)
+    {
+        resetTiles();
+        for(auto& op: ans){
+            std::size_t pos = flatten(op.select);
+            for(char c: op.moves)
+                pos = swapTo(pos, c);
+        }
+
+        return _tiles;
+    }
+
+
+  private:
+    std::size_t _div_x;
+    std::size_t _div_y;
+    int _select_cost;
+    int _change_cost;
+    MoveTable _moves;
+
+    std::vector<uint16_t> _tiles;   // 位置 -> 断片
+    std::vector<uint16_t> _classes; // 断片 -> クラス (空なら断片そのもの)
+    uint64_t _hash;                 // _tilesのZobristハッシュ
+    MonotonicArena _arena;          // removeCyclesの作業領域。呼び出しごとに巻き戻す
+
+
+    uint64_t tileKey(std::size_t pos, uint16_t tile) const
+    {
+        return mix64((static_cast<uint64_t>(pos) << 16) | classOf(tile));
+    }
+
+
+    uint16_t classOf(uint16_t tile) const { return _classes.empty() ? tile : _classes[tile]; }
+
+
+    static uint64_t cursorKey(std::size_t pos)
+    {
+        return mix64((static_cast<uint64_t>(1) << 48) | pos);
+    }
+
+
+    std::size_t flatten(Index2D idx) const { return idx[0] * _div_x + idx[1]; }
+
+
+    void resetTiles()
+    {
+        const std::size_t n = _div_x * _div_y;
+        _tiles.resize(n);
+        _hash = 0;
+        for(std::size_t i = 0; i < n; ++i){
+            _tiles[i] = static_cast<uint16_t>(i);
+            _hash ^= tileKey(i, _tiles[i]);
+        }
+    }
+
+
+    /// 位置`p`で選択中の断片を方向`c`に交換し、新しい選択位置を返します
+    std::size_t swapTo(std::size_t p, char c)
+    {
+        const std::size_t q = isDirectionChar(c) ? _moves.move(p, toDirection(c)) : _moves.cells();
+        PROCON_ENFORCE(q != _moves.cells(), format("Simulation Error: % at (%, %)", c, p / _div_x, p % _div_x));
+
+        const uint16_t a = _tiles[p],
+                       b = _tiles[q];
+
+        _hash ^= tileKey(p, a) ^ tileKey(q, b) ^ tileKey(p, b) ^ tileKey(q, a);
+        _tiles[p] = b;
+        _tiles[q] = a;
+
+        return q;
+    }
+
+
+    static std::string cancelInversePairs(std::string const & moves)
+    {
+        std::string dst;
+        dst.reserve(moves.size());
+        for(char c: moves){
+            if(!dst.empty() && dst.back() == inverseMove(c))
+                dst.pop_back();
+            else
+                dst.push_back(c);
+        }
+
+        return dst;
+    }
+
+
+    /** 現在の配置から`start`を選択して`moves`を適用しつつ、
+    既に訪れた状態に戻る部分列を取り除きます。
+    適用後の配置と選択位置は、元の`moves`を適用した場合と同一です。
+    */
+    std::string removeCycles(Index2D start, std::string const & moves)
+    {
+        std::string dst;
+        dst.reserve(moves.size());
+
+        // 訪れた状態の表はアリーナから確保するので、定常状態ではノードごとの確保が起きない
+        typedef std::pair<const uint64_t, std::size_t> Entry;
+        _arena.reset();
+        std::unordered_map<uint64_t, std::size_t, std::hash<uint64_t>, std::equal_to<uint64_t>, ArenaAllocator<Entry>>
+            seen(moves.size() + 1, std::hash<uint64_t>(), std::equal_to<uint64_t>(), ArenaAllocator<Entry>(_arena));
+        ArenaVector<uint64_t> history{ArenaAllocator<uint64_t>(_arena)};
+        history.reserve(moves.size() + 1);
+
+        std::size_t pos = flatten(start);
+        uint64_t h = _hash ^ cursorKey(pos);
+        seen.emplace(h, 0);
+        history.push_back(h);
+
+        for(char c: moves){
+            pos = swapTo(pos, c);
+            h = _hash ^ cursorKey(pos);
+            dst.push_back(c);
+
+            auto it = seen.find(h);
+            if(it != seen.end()){
+                // dst[k, $)は状態を元に戻すだけの部分列
+                const std::size_t k = it->second;
+                for(std::size_t i = k + 1; i < history.size(); ++i)
+                    seen.erase(history[i]);
+
+                history.resize(k + 1);
+                dst.resize(k);
+            }else{
+                seen.emplace(h, dst.size());
+                history.push_back(h);
+            }
+        }
+
+        return dst;
+    }
+
+
+    /** 空の選択を取り除き、直前の選択の終了位置を選択している選択を直前の選択に結合します。
+    */
+    void mergeSelections(Answer& ans) const
+    {
+        Answer dst;
+        dst.reserve(ans.size());
+
+        Index2D last{};
+        for(auto& op: ans){
+            if(op.moves.empty())
+                continue;
+
+            if(!dst.empty() && last == op.select)
+                dst.back().moves += op.moves;
+            else
+                dst.push_back(op);
+
+            last = op.select;
+            for(char c: op.moves)
+                PROCON_ENFORCE(moveIndex(last, c, _div_x, _div_y), "Simulation Error");
+        }
+
+        ans = std::move(dst);
+    }
+
+
+    bool isSameArrangement(Answer const & a, Answer const & b)
+    {
+        auto arrA = arrangement(a),
+             arrB = arrangement(b);
+
+        for(auto& t: arrA) t = classOf(t);
+        for(auto& t: arrB) t = classOf(t);
+        return arrA == arrB;
+    }
+};
+
+
+/** `MoveOptimizer`を一度だけ使う場合のヘルパー関数です
+*/
+inline Answer optimizeAnswer(Problem const & pb, Answer const & ans)
+{
+    MoveOptimizer opt(pb);
+    return opt.optimize(ans);
+}
+
+}} // namespace procon::utils
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <boost/optional.hpp>
+#include "exception.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 協調的な中断のためのトークンです。
+コピーしたトークンは同じ状態を共有します。処理側は`cancelled()`を定期的に調べて、真なら早めに終了してください。
+*/
+class CancellationToken
+{
+  public:
+    CancellationToken() : _flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+
+    void cancel() const { _flag->store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return _flag->load(std::memory_order_relaxed); }
+
+
+  private:
+    std::shared_ptr<std::atomic<bool>> _flag;
+};
+
+
+/** 複数の関数を並列に実行した結果をまとめたものです。`collectExceptionParallel`で作ります。
+
++ `first_success()`  最初に成功した結果を待ち、残りを中断して、その結果を`CollectException`で返します
++ `best_by(score)`   全ての結果を待ち、成功したもののうち`score`が最大の結果を返します
++ `onSuccess`, `onFailure`  全ての結果を待ち、成功・失敗したもの全てについて関数を呼びます
+
+どの場合も、全てのスレッドの終了を待ってから結果を返します。
+デストラクタは中断を要求してから全てのスレッドの終了を待ちます。
+*/
+template <typename T, typename Ex>
+class ParallelCollectException
+{
+  public:
+    typedef std::function<T(CancellationToken const &)> Task;
+
+
+    ParallelCollectException(std::vector<Task> tasks, CancellationToken token)
+    : _state(std::make_unique<State>(tasks.size())), _token(token)
+    {
+        // ムーブされてもスレッドから見える状態が動かないよう、thisではなく状態とトークンを渡す
+        try{
+            for(std::size_t i = 0; i < tasks.size(); ++i)
+                _threads.emplace_back([st = _state.get(), token, i, f = std::move(tasks[i])](){ run(*st, token, i, f); });
+        }
+        catch(...){
+            // デストラクタは呼ばれないので、起動済みのスレッドをここで止めて待つ
+            _token.cancel();
+            join();
+            throw;
+        }
+    }
+
+
+    ParallelCollectException(ParallelCollectException&&) = default;
+
+
+    ~ParallelCollectException()
+    {
+        if(!_state)     // ムーブ済み
+            return;
+
+        _token.cancel();
+        join();
+    }
+
+
+    std::size_t size() const { return _state->values.size(); }
+
+
+    /// 全ての関数に中断を要求します
+    void cancel() { _token.cancel(); }
+
+
+    CancellationToken const & token() const { return _token; }
+
+
+    /** 最初に成功した結果を返し、残りの関数には中断を要求します。
+    全て失敗した場合は、最初に失敗した関数の例外を保持した`CollectException`を返します。
+    */
+    CollectException<T, Ex> first_success()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_state->mutex);
+            _state->cv.wait(lock, [&]{ return _state->first || _state->done == size(); });
+        }
+
+        _token.cancel();
+        join();
+        return result(_state->first);
+    }
+
+
+    /** 成功した結果のうち、`score(value)`が最大のものを返します。同じ値の場合は先に渡した関数の結果を選びます。
+    全て失敗した場合は、最初に失敗した関数の例外を保持した`CollectException`を返します。
+    */
+    template <typename F>
+    CollectException<T, Ex> best_by(F score)
+    {
+        join();
+
+        boost::optional<std::size_t> best;
+        for(std::size_t i = 0; i < size(); ++i)
+            if(_state->values[i] && (!best || score(*_state->values[*best]) < score(*_state->values[i])))
+                best = i;
+
+        return result(best);
+    }
+
+
+    /// 成功した全ての結果について、渡した順に`f(index, value)`を呼びます
+    template <typename F>
+    ParallelCollectException& onSuccess(F f)
+    {
+        join();
+        for(std::size_t i = 0; i < size(); ++i)
+            if(_state->values[i])
+                f(i, *_state->values[i]);
+
+        return *this;
+    }
+
+
+    /// 失敗した全ての結果について、渡した順に`f(index, ex)`を呼びます
+    template <typename F>
+    ParallelCollectException& onFailure(F f)
+    {
+        join();
+        for(std::size_t i = 0; i < size(); ++i)
+            if(_state->errors[i]){
+                try{
+                    std::rethrow_exception(_state->errors[i]);
+                }
+                catch(Ex& ex){
+                    f(i, ex);
+                }
+            }
+
+        return *this;
+    }
+
+
+  private:
+    struct State
+    {
+        explicit State(std::size_t n) : values(n), errors(n), done(0) {}
+
+        std::vector<boost::optional<T>> values;
+        std::vector<std::exception_ptr> errors;
+        std::size_t done;
+        boost::optional<std::size_t> first;     // 最初に成功した関数
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    std::unique_ptr<State> _state;
+    CancellationToken _token;
+    std::vector<std::thread> _threads;
+
+
+    static void run(State& st, CancellationToken const & token, std::size_t i, Task const & f)
+    {
+        boost::optional<T> v;
+        std::exception_ptr ex;
+        try{
+            v = f(token);
+        }
+        catch(...){
+            ex = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(st.mutex);
+        st.values[i] = std::move(v);
+        st.errors[i] = ex;
+        if(!ex && !st.first)
+            st.first = i;
+
+        ++st.done;
+        st.cv.notify_all();
+    }
+
+
+    void join()
+    {
+        for(auto& th: _threads)
+            if(th.joinable())
+                th.join();
+    }
+
+
+    CollectException<T, Ex> result(boost::optional<std::size_t> i)
+    {
+        if(i)
+            return CollectException<T, Ex>(T(*_state->values[*i]));
+
+        auto it = std::find_if(_state->errors.begin(), _state->errors.end(), [](std::exception_ptr const & e){ return static_cast<bool>(e); });
+        std::exception_ptr ex = it != _state->errors.end() ? *it : std::make_exception_ptr(std::runtime_error("no task succeeded"));
+        return CollectException<T, Ex>(std::move(ex));
+    }
+};
+
+
+/** 複数の関数を並列に実行し、それぞれの例外を捕捉します。`collectException`の並列版です。
+各関数には`CancellationToken`が渡されるので、中断を要求されたら早めに終了してください。
+全ての関数の戻り値の型は同じである必要があります。
+
+Example:
+------------
+auto rs = collectExceptionParallel<std::runtime_error>(
+    [&](CancellationToken const & t){ return solveByGreedy(pb, t); },
+    [&](CancellationToken const & t){ return solveByBeamSearch(pb, t); });
+
+rs.best_by([&](Answer const & a){ return -(long)answerCost(a, pb.select_cost(), pb.change_cost()); })
+.onSuccess([&](Answer&& a){ writeAnswer(std::cout, a); })
+.onFailure([&](std::runtime_error& ex){ writeln(ex.what()); });
+------------
+*/
+template <typename Ex, typename T>
+ParallelCollectException<T, Ex> collectExceptionParallel(std::vector<std::function<T(CancellationToken const &)>> tasks,
+                                                         CancellationToken token = CancellationToken())
+{
+    return ParallelCollectException<T, Ex>(std::move(tasks), token);
+}
+
+
+/// ditto
+template <typename Ex, typename F, typename... Fs>
+auto collectExceptionParallel(F f, Fs... fs)
+-> ParallelCollectException<std::decay_t<decltype(f(std::declval<CancellationToken const &>()))>, Ex>
+{
+    typedef std::decay_t<decltype(f(std::declval<CancellationToken const &>()))> T;
+    return ParallelCollectException<T, Ex>(
+        std::vector<std::function<T(CancellationToken const &)>>{std::move(f), std::move(fs)...}, CancellationToken());
+}
+
+}} // namespace procon::utils
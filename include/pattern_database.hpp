@@ -0,0 +1,474 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <boost/optional.hpp>
+#include "image.hpp"
+#include "exception.hpp"
+#include "dwrite.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 選択した断片を'U', 'D', 'L', 'R'で動かす探索のための、加法的パターンデータベースです。
+
+盤面の部分領域(幅 width, 高さ height, 例えば最後の数行)について、
+断片をいくつかのグループ(パターン)に分け、パターンごとに
+「パターンに属する断片を全て目標位置に戻すために、それらの断片が動かされる最小回数」を前計算します。
+選択中の断片が動くとき、一緒に動く断片は高々1つなので、パターン間の値の和も許容的なヒューリスティックになります。
+
+断片は領域内の目標位置 `r * width + c` で識別します。
+選択する断片はどのパターンにも含めないでください。
+
+テーブルは、パターン内の断片の位置 `p_i` から `sum p_i * n^i` (n = width * height) で引くので、
+探索中に断片が1つ動いた場合の差分更新もO(1)です。
+
+構築はパターンごとに並列に行われます。
+`save`で保存したファイルは`load`でmmapされるので、次回以降は構築の時間がかかりません。
+
+Example:
+------------
+// 16x16の最後の2行, (1, 15)を選択して解く
+auto pats = PatternDatabase::makePatterns(16, 2, 1 * 16 + 15, 4);
+auto pdb = PatternDatabase::build(16, 2, pats);
+pdb.save("last2rows.pdb");
+
+auto pdb2 = PatternDatabase::load("last2rows.pdb");
+auto moves = solveWithPatternDatabase(pdb2, cellTile, 1 * 16 + 15, 80);
+------------
+*/
+class PatternDatabase
+{
+  public:
+    typedef std::vector<uint16_t> Pattern;
+
+    /// 1つのパターンに含められる断片の最大数
+    static constexpr std::size_t maxPatternSize = 8;
+
+
+    PatternDatabase(PatternDatabase&&) = default;
+    PatternDatabase& operator=(PatternDatabase&&) = default;
+
+
+    /** 領域の大きさとパターンを指定して、データベースを構築します。
+    */
+    static PatternDatabase build(std::size_t width, std::size_t height, std::vector<Pattern> const & patterns)
+    {
+        const std::size_t n = width * height;
+        PROCON_ENFORCE(n > 0 && n <= 256, "invalid region size");
+        for(auto& pat: patterns){
+            PROCON_ENFORCE(!pat.empty() && pat.size() <= maxPatternSize, "invalid pattern size");
+            PROCON_ENFORCE(power(n, pat.size() + 1) <= std::numeric_limits<uint32_t>::max(), "pattern is too large");
+            for(auto t: pat)
+                PROCON_ENFORCE(t < n, format("tile % is out of the region", t));
+        }
+
+        // 既定のスレッドプールで並列にテーブルを構築する
+        std::vector<std::vector<uint8_t>> tables(patterns.size());
+        defaultThreadPool().parallel_for(iota(patterns.size()), [&](std::size_t j){
+            tables[j] = buildTable(width, height, patterns[j]);
+        });
+
+        // ファイルと同じ形式のバイト列にまとめる
+        std::vector<uint8_t> bytes(sizeof(Header) + sizeof(PatternInfo) * patterns.size());
+        Header header;
+        std::memcpy(header.magic, magic(), sizeof(header.magic));
+        header.width = static_cast<uint32_t>(width);
+        header.height = static_cast<uint32_t>(height);
+        header.numPatterns = static_cast<uint32_t>(patterns.size());
+        header.reserved = 0;
+        std::memcpy(bytes.data(), &header, sizeof(header));
+
+        for(std::size_t i = 0; i < patterns.size(); ++i){
+            PatternInfo info = {};
+            info.numTiles = static_cast<uint32_t>(patterns[i].size());
+            info.offset = bytes.size();
+            info.length = tables[i].size();
+            std::copy(patterns[i].begin(), patterns[i].end(), info.tiles);
+            std::memcpy(bytes.data() + sizeof(Header) + sizeof(PatternInfo) * i, &info, sizeof(info));
+
+            bytes.insert(bytes.end(), tables[i].begin(), tables[i].end());
+            bytes.resize((bytes.size() + 7) / 8 * 8);
+        }
+
+        PatternDatabase dst;
+        dst._bytes = std::move(bytes);
+        dst.setup(dst._bytes.data(), dst._bytes.size());
+        return dst;
+    }
+
+
+    /** `save`で保存したデータベースをmmapして読み込みます。
+    */
+    static PatternDatabase load(std::string const & path)
+    {
+        PatternDatabase dst;
+        dst._file = MappedFile(path);
+        dst.setup(dst._file.data(), dst._file.size());
+        return dst;
+    }
+
+
+    /// データベースをファイルに保存します
+    void save(std::string const & path) const
+    {
+        std::ofstream ofs(path, std::ios::binary);
+        PROCON_ENFORCE(ofs, format("cannot open %", path));
+        ofs.write(reinterpret_cast<const char*>(_data), _size);
+        PROCON_ENFORCE(ofs, format("cannot write %", path));
+    }
+
+
+    /** 領域内の断片を、`selected`を除いて`groupSize`個ずつのパターンに分けます。
+    列優先で分けるので、高さの小さい領域では隣接した断片が同じパターンになります。
+    */
+    static std::vector<Pattern> makePatterns(std::size_t width, std::size_t height, uint16_t selected, std::size_t groupSize)
+    {
+        std::vector<Pattern> dst;
+        for(auto c: iota(width))
+            for(auto r: iota(height)){
+                const auto t = static_cast<uint16_t>(r * width + c);
+                if(t == selected)
+                    continue;
+
+                if(dst.empty() || dst.back().size() == groupSize)
+                    dst.emplace_back();
+
+                dst.back().push_back(t);
+            }
+
+        return dst;
+    }
+
+
+    std::size_t width() const { return _width; }
+    std::size_t height() const { return _height; }
+    std::size_t cells() const { return _width * _height; }
+    std::size_t numPatterns() const { return _patterns.size(); }
+    Pattern const & pattern(std::size_t i) const { return _patterns[i]; }
+
+
+    /// 断片`tile`が属するパターンの番号を返します。どのパターンにも属さない場合は-1を返します。
+    int patternOf(uint16_t tile) const { return _patternOf[tile]; }
+
+
+    /// 断片`tile`が1マス動いたときの、その断片が属するパターンのランクの変化量の単位を返します
+    std::size_t weightOf(uint16_t tile) const { return _weightOf[tile]; }
+
+
+    /** `i`番目のパターンのランクを計算します。
+    `tilePos[t]`は断片tの現在位置です。
+    */
+    std::size_t rank(std::size_t i, const uint16_t* tilePos) const
+    {
+        std::size_t r = 0;
+        for(auto t: _patterns[i])
+            r += tilePos[t] * _weightOf[t];
+
+        return r;
+    }
+
+
+    /// `i`番目のパターンのテーブルを引きます
+    uint8_t lookup(std::size_t i, std::size_t rank) const { return _tables[i][rank]; }
+
+
+    /// 全パターンの値の和を返します
+    std::size_t estimate(const uint16_t* tilePos) const
+    {
+        std::size_t sum = 0;
+        for(std::size_t i = 0; i < _patterns.size(); ++i)
+            sum += lookup(i, rank(i, tilePos));
+
+        return sum;
+    }
+
+
+  private:
+    struct Header
+    {
+        char magic[8];
+        uint32_t width;
+        uint32_t height;
+        uint32_t numPatterns;
+        uint32_t reserved;
+    };
+
+    struct PatternInfo
+    {
+        uint32_t numTiles;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t length;
+        uint16_t tiles[maxPatternSize];
+    };
+
+    static_assert(sizeof(Header) == 24, "unexpected padding");
+    static_assert(sizeof(PatternInfo) == 40, "unexpected padding");
+
+
+    std::vector<uint8_t> _bytes;    // buildした場合のデータ
+    MappedFile _file;               // loadした場合のデータ
+    const uint8_t* _data = nullptr;
+    std::size_t _size = 0;
+
+    std::size_t _width = 0;
+    std::size_t _height = 0;
+    std::vector<Pattern> _patterns;
+    std::vector<const uint8_t*> _tables;
+    std::vector<int> _patternOf;
+    std::vector<std::size_t> _weightOf;
+
+
+    PatternDatabase() = default;
+
+
+    static const char* magic() { return "PCPDB001"; }
+
+
+    static std::size_t power(std::size_t n, std::size_t k)
+    {
+        std::size_t dst = 1;
+        for(std::size_t i = 0; i < k; ++i)
+            dst *= n;
+
+        return dst;
+    }
+
+
+    void setup(const uint8_t* data, std::size_t size)
+    {
+        _data = data;
+        _size = size;
+
+        PROCON_ENFORCE(size >= sizeof(Header), "broken pattern database");
+        Header header;
+        std::memcpy(&header, data, sizeof(header));
+        PROCON_ENFORCE(std::memcmp(header.magic, magic(), sizeof(header.magic)) == 0, "not a pattern database");
+        PROCON_ENFORCE(size >= sizeof(Header) + sizeof(PatternInfo) * header.numPatterns, "broken pattern database");
+
+        _width = header.width;
+        _height = header.height;
+        const std::size_t n = cells();
+        _patternOf.assign(n, -1);
+        _weightOf.assign(n, 0);
+
+        for(std::size_t i = 0; i < header.numPatterns; ++i){
+            PatternInfo info;
+            std::memcpy(&info, data + sizeof(Header) + sizeof(PatternInfo) * i, sizeof(info));
+            PROCON_ENFORCE(info.numTiles <= maxPatternSize
+                        && info.length == power(n, info.numTiles)
+                        && info.offset + info.length <= size, "broken pattern database");
+
+            _patterns.emplace_back(info.tiles, info.tiles + info.numTiles);
+            _tables.push_back(data + info.offset);
+
+            std::size_t w = 1;
+            for(auto t: _patterns.back()){
+                PROCON_ENFORCE(t < n && _patternOf[t] == -1, "broken pattern database");
+                _patternOf[t] = static_cast<int>(i);
+                _weightOf[t] = w;
+                w *= n;
+            }
+        }
+    }
+
+
+    /** 0-1 BFSでパターンのテーブルを構築します。
+    状態は (パターンの断片の位置, 選択中の断片の位置) で、パターンの断片が動く場合のみコスト1です。
+    最後に選択中の断片の位置について最小値をとります。
+    */
+    static std::vector<uint8_t> buildTable(std::size_t width, std::size_t height, Pattern const & pat)
+    {
+        const std::size_t n = width * height,
+                          k = pat.size(),
+                          nRank = power(n, k);
+
+        std::vector<std::size_t> weight(k);
+        std::size_t goal = 0;
+        for(std::size_t i = 0; i < k; ++i){
+            weight[i] = power(n, i);
+            goal += pat[i] * weight[i];
+        }
+
+        std::vector<uint8_t> dist(nRank * n, 0xFF);
+        std::deque<uint32_t> que;
+        for(auto b: iota(n))
+            if(std::find(pat.begin(), pat.end(), b) == pat.end()){
+                dist[goal * n + b] = 0;
+                que.push_back(static_cast<uint32_t>(goal * n + b));
+            }
+
+        std::size_t pos[maxPatternSize];
+        while(!que.empty()){
+            const std::size_t s = que.front();
+            que.pop_front();
+
+            const std::size_t r = s / n,
+                              b = s % n;
+            const uint8_t d = dist[s];
+
+            std::size_t rr = r;
+            for(std::size_t i = 0; i < k; ++i){
+                pos[i] = rr % n;
+                rr /= n;
+            }
+
+            const std::size_t br = b / width, bc = b % width;
+            const std::size_t nbs[4] = {
+                bc + 1 < width ? b + 1 : n,
+                br > 0 ? b - width : n,
+                bc > 0 ? b - 1 : n,
+                br + 1 < height ? b + width : n,
+            };
+
+            for(auto nb: nbs){
+                if(nb == n)
+                    continue;
+
+                const std::size_t i = std::find(pos, pos + k, nb) - pos;
+                if(i != k){
+                    // パターンの断片が選択中の断片の位置へ動く
+                    const std::size_t ns = (r - nb * weight[i] + b * weight[i]) * n + nb;
+                    const uint8_t nd = std::min(d + 1, 0xFE);
+                    if(nd < dist[ns]){
+                        dist[ns] = nd;
+                        que.push_back(static_cast<uint32_t>(ns));
+                    }
+                }else{
+                    const std::size_t ns = r * n + nb;
+                    if(d < dist[ns]){
+                        dist[ns] = d;
+                        que.push_front(static_cast<uint32_t>(ns));
+                    }
+                }
+            }
+        }
+
+        std::vector<uint8_t> table(nRank, 0xFF);
+        for(std::size_t r = 0; r < nRank; ++r)
+            table[r] = *std::min_element(dist.begin() + r * n, dist.begin() + (r + 1) * n);
+
+        return table;
+    }
+};
+
+
+/** パターンデータベースをヒューリスティックとしたIDA*で、
+領域内の配置を目標配置に戻す最短の交換操作列を探索します。
+
+`cellTile[c]`は、領域内の位置cにある断片(の目標位置)です。
+`selected`は選択する断片で、どのパターンにも含まれない必要があります。
+`maxDepth`手以内で解けない場合は`boost::none`を返します。
+*/
+inline boost::optional<std::string> solveWithPatternDatabase(PatternDatabase const & pdb, std::vector<uint16_t> const & cellTile, uint16_t selected, std::size_t maxDepth)
+{
+    struct Search
+    {
+        PatternDatabase const & pdb;
+        MoveTable moves;
+        std::vector<uint16_t> cellTile;
+        std::vector<uint16_t> tilePos;
+        std::vector<std::size_t> ranks;
+        std::size_t h;
+        std::size_t misplaced;
+        std::size_t blank;
+        std::string path;
+
+        static std::size_t found() { return std::numeric_limits<std::size_t>::max(); }
+
+
+        // 選択中の断片と位置nbの断片を交換する
+        void swapBlank(std::size_t nb)
+        {
+            const uint16_t t = cellTile[nb],
+                           s = cellTile[blank];
+
+            misplaced -= (t != nb) + (s != blank);
+            misplaced += (t != blank) + (s != nb);
+
+            const int p = pdb.patternOf(t);
+            if(p >= 0){
+                h -= pdb.lookup(p, ranks[p]);
+                ranks[p] = ranks[p] - nb * pdb.weightOf(t) + blank * pdb.weightOf(t);
+                h += pdb.lookup(p, ranks[p]);
+            }
+
+            std::swap(cellTile[nb], cellTile[blank]);
+            tilePos[t] = static_cast<uint16_t>(blank);
+            tilePos[s] = static_cast<uint16_t>(nb);
+            blank = nb;
+        }
+
+
+        std::size_t dfs(std::size_t g, std::size_t bound, int prevDir)
+        {
+            const std::size_t f = g + h;
+            if(f > bound) return f;
+            if(misplaced == 0) return found();
+
+            std::size_t next = std::numeric_limits<std::size_t>::max() - 1;
+            for(int dir = 0; dir < 4; ++dir){
+                // 直前の操作を打ち消す操作は行わない
+                if(prevDir >= 0 && (prevDir + 2) % 4 == dir)
+                    continue;
+
+                const std::size_t nb = moves.move(blank, static_cast<Direction>(dir));
+                if(nb == moves.cells())
+                    continue;
+
+                const std::size_t old = blank;
+                swapBlank(nb);
+                path.push_back("RULD"[dir]);
+
+                const std::size_t t = dfs(g + 1, bound, dir);
+                if(t == found())
+                    return found();
+
+                next = std::min(next, t);
+                path.pop_back();
+                swapBlank(old);
+            }
+
+            return next;
+        }
+    };
+
+    const std::size_t n = pdb.cells();
+    PROCON_ENFORCE(cellTile.size() == n, "cellTile has invalid size");
+    PROCON_ENFORCE(selected < n && pdb.patternOf(selected) < 0, "selected tile must not be in any pattern");
+
+    Search s{pdb, MoveTable(pdb.width(), pdb.height()), cellTile, std::vector<uint16_t>(n), std::vector<std::size_t>(pdb.numPatterns()), 0, 0, 0, std::string()};
+    for(auto c: iota(n)){
+        s.tilePos[cellTile[c]] = static_cast<uint16_t>(c);
+        s.misplaced += cellTile[c] != c;
+    }
+
+    s.blank = s.tilePos[selected];
+    s.path.reserve(maxDepth);        // 探索中は確保しなおさない
+    for(auto i: iota(pdb.numPatterns())){
+        s.ranks[i] = pdb.rank(i, s.tilePos.data());
+        s.h += pdb.lookup(i, s.ranks[i]);
+    }
+
+    std::size_t bound = s.h;
+    while(bound <= maxDepth){
+        const std::size_t t = s.dfs(0, bound, -1);
+        if(t == Search::found())
+            return s.path;
+
+        bound = t;
+    }
+
+    return boost::none;
+}
+
+}} // namespace procon::utils
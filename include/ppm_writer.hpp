@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/optional.hpp>
+#include "image.hpp"
+#include "exception.hpp"
+#include "dwrite.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 画像をバイナリPPM(P6)で書き出します。
+`SwappedImage`は断片の対応表から1行ずつ直接書き出すので、並べ替えた`cv::Mat`を作りません。
+OpenCVのhighguiを使わないので、ディスプレイの無い環境でも結果を確認できます。
+
+Example:
+------------
+writePPM("answer.ppm", swpImage);
+
+// 選択中の断片を赤く表示する
+writePPM("frame.ppm", swpImage, Position(2, 3));
+------------
+*/
+class PPMWriter
+{
+  public:
+    explicit PPMWriter(std::ostream& os) : _os(os) {}
+
+
+    /// ヘッダを書き出します。`comments`は`# `に続けて1行ずつ書き出されます。
+    void header(std::size_t width, std::size_t height, std::vector<std::string> const & comments = {})
+    {
+        _os << "P6\n";
+        for(auto& c: comments)
+            _os << "# " << c << "\n";
+        _os << width << " " << height << "\n255\n";
+        _row.resize(width * 3);
+    }
+
+
+    /** BGRの1行を、RGBに並べ替えて書き出します。
+    [first, last)のピクセルは赤と半分ずつ混ぜます。
+    */
+    void row(const uint8_t* bgr, std::size_t first = 0, std::size_t last = 0)
+    {
+        const std::size_t w = _row.size() / 3;
+        for(std::size_t x = 0; x < w; ++x){
+            _row[x * 3 + 0] = bgr[x * 3 + 2];
+            _row[x * 3 + 1] = bgr[x * 3 + 1];
+            _row[x * 3 + 2] = bgr[x * 3 + 0];
+        }
+
+        for(std::size_t x = first; x < last; ++x){
+            _row[x * 3 + 0] = static_cast<uint8_t>((_row[x * 3 + 0] + 255) / 2);
+            _row[x * 3 + 1] /= 2;
+            _row[x * 3 + 2] /= 2;
+        }
+
+        _os.write(reinterpret_cast<const char*>(_row.data()), _row.size());
+    }
+
+
+    /// BGRの1行を組み立てるための作業領域を返します
+    std::vector<uint8_t>& buffer(std::size_t width)
+    {
+        _bgr.resize(width * 3);
+        return _bgr;
+    }
+
+
+  private:
+    std::ostream& _os;
+    std::vector<uint8_t> _row;
+    std::vector<uint8_t> _bgr;
+};
+
+
+/// 画像をそのまま書き出します
+inline void writePPM(std::ostream& os, ImageView img)
+{
+    PPMWriter w(os);
+    w.header(img.width(), img.height());
+    for(auto y: iota(img.height()))
+        w.row(img.row(y));
+}
+
+
+/** 問題画像を、`Problem::get`で読み込める形式(分割数などのコメント付き)で書き出します。
+*/
+inline void writePPM(std::ostream& os, Problem const & pb)
+{
+    const auto img = pb.view().master();
+
+    PPMWriter w(os);
+    w.header(img.width(), img.height(), {
+        text(pb.div_x(), " ", pb.div_y()),
+        text(pb.max_select_times()),
+        text(pb.select_cost(), " ", pb.change_cost()),
+    });
+
+    for(auto y: iota(img.height()))
+        w.row(img.row(y));
+}
+
+
+/** 断片を並べ替えた画像を書き出します。
+`selected`を指定すると、その位置の断片を`simulator.cpp`と同じように赤く表示します。
+*/
+inline void writePPM(std::ostream& os, SwappedImage const & img, boost::optional<Position> selected = boost::none)
+{
+    const auto master = img.dividedImage().view();
+    const std::size_t width = img.width(),
+                      height = img.height(),
+                      ww = width / img.div_x(),
+                      hh = height / img.div_y(),
+                      tiledW = ww * img.div_x(),
+                      tiledH = hh * img.div_y();
+
+    PPMWriter w(os);
+    w.header(width, height);
+    auto& buf = w.buffer(width);
+
+    for(std::size_t y = 0; y < height; ++y){
+        // 分割数で割り切れない端の部分は元の画像のまま
+        if(y >= tiledH){
+            w.row(master.master().row(y));
+            continue;
+        }
+
+        const std::size_t i = y / hh;
+        for(auto j: iota(img.div_x()))
+            img.element_row(i, j, y % hh, buf.data() + j * ww * 3);
+        std::memcpy(buf.data() + tiledW * 3, master.master().row(y) + tiledW * 3, (width - tiledW) * 3);
+
+        if(selected && selected->row() == i)
+            w.row(buf.data(), selected->col() * ww, (selected->col() + 1) * ww);
+        else
+            w.row(buf.data());
+    }
+}
+
+
+/// ファイルに書き出します
+template <typename T>
+void writePPM(std::string const & path, T const & img)
+{
+    std::ofstream ofs(path, std::ios::binary);
+    PROCON_ENFORCE(ofs, format("cannot open %", path));
+    writePPM(ofs, img);
+    PROCON_ENFORCE(ofs, format("cannot write %", path));
+}
+
+
+/// ditto
+inline void writePPM(std::string const & path, SwappedImage const & img, Position selected)
+{
+    std::ofstream ofs(path, std::ios::binary);
+    PROCON_ENFORCE(ofs, format("cannot open %", path));
+    writePPM(ofs, img, selected);
+    PROCON_ENFORCE(ofs, format("cannot write %", path));
+}
+
+}} // namespace procon::utils
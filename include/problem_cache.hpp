@@ -0,0 +1,242 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/optional.hpp>
+#include "image.hpp"
+#include "types.hpp"
+#include "cost_table.hpp"
+#include "mapped_file.hpp"
+#include "exception.hpp"
+#include "dwrite.hpp"
+
+
+namespace procon { namespace utils {
+
+/// キャッシュから読み込んだ、または新たに計算した問題の前処理結果です
+struct CachedProblemData
+{
+    uint64_t fingerprint;
+    FragmentEdges edges;
+    CostTable costs;
+};
+
+
+/** 問題画像の前処理結果(断片のエッジと相性の表)を、画素の内容をキーにしてディスクに保存します。
+同じ問題画像を再び解くときは、保存したファイルをmmapするだけなので前処理の時間がかかりません。
+
+キーは画素と分割数から計算する64bitのハッシュ値(`fingerprint`)で、ファイル名はその16進表記です。
+ファイルの書き込みは一時ファイルへの書き込みとrenameで行うので、複数のプロセスが同じディレクトリを共有できます。
+保存先のディレクトリは予め作っておいてください。
+
+Example:
+------------
+ProblemCache cache("cache");
+auto data = cache.get(pb.view());   // 初回は計算して保存、2回目以降はmmap
+float c = data.costs.cost(a, b, Direction::right);
+------------
+*/
+class ProblemCache
+{
+  public:
+    explicit ProblemCache(std::string const & dir) : _dir(dir) {}
+
+
+    std::string const & directory() const { return _dir; }
+
+
+    /** 画像の画素と分割数から、キャッシュのキーを計算します。
+    画像の行ごとのパディングは含めないので、同じ画素の画像ならメモリ上の配置によらず同じ値になります。
+    */
+    static uint64_t fingerprint(DividedImageView img)
+    {
+        const auto m = img.master();
+        const uint64_t dims[] = { m.width(), m.height(), img.div_x(), img.div_y() };
+
+        uint64_t h = hashBytes(dims, sizeof(dims), 0);
+        for(auto y: iota(m.height()))
+            h = hashBytes(m.row(y), m.width() * 3, h);
+
+        return mix64(h);
+    }
+
+
+    /// キーに対応するファイルのパスを返します
+    std::string pathOf(uint64_t fp) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.pcc", static_cast<unsigned long long>(fp));
+        return _dir + "/" + name;
+    }
+
+
+    /** キャッシュを探します。
+    ファイルが無い場合や、形式が合わない壊れたファイルの場合は`boost::none`を返します。
+    */
+    boost::optional<CachedProblemData> find(DividedImageView img) const
+    {
+        return find(img, fingerprint(img));
+    }
+
+
+    /// 計算済みの前処理結果を保存し、保存したファイルをmmapしたものを返します
+    CachedProblemData store(DividedImageView img, FragmentEdges const & edges, CostTable const & costs) const
+    {
+        PROCON_ENFORCE(edges.orientations() == 1, "only upright edges can be cached");
+
+        const uint64_t fp = fingerprint(img);
+        write(pathOf(fp), fp, edges, costs);
+
+        auto dst = find(img, fp);
+        PROCON_ENFORCE(dst, format("cannot read back %", pathOf(fp)));
+        return *dst;
+    }
+
+
+    /** キャッシュがあれば読み込み、無ければ計算して保存します。
+    保存に失敗した場合(ディレクトリが書き込めないなど)も、計算した結果を返します。
+    */
+    CachedProblemData get(DividedImageView img) const
+    {
+        const uint64_t fp = fingerprint(img);
+        if(auto dst = find(img, fp))
+            return *dst;
+
+        FragmentEdges edges(img);
+        CostTable costs(img, edges);
+
+        try{
+            write(pathOf(fp), fp, edges, costs);
+        }
+        catch(std::exception&){}
+
+        return CachedProblemData{fp, edges, costs};
+    }
+
+
+  private:
+    struct Header
+    {
+        char magic[8];
+        uint64_t fingerprint;
+        uint32_t div_x;
+        uint32_t div_y;
+        uint32_t fragmentWidth;
+        uint32_t fragmentHeight;
+        uint64_t edgesOffset;
+        uint64_t edgesBytes;
+        uint64_t costsOffset;
+        uint64_t costsValues;
+    };
+
+    static_assert(sizeof(Header) == 64, "unexpected padding");
+
+
+    std::string _dir;
+
+
+    static const char* magic() { return "PCPCC001"; }
+
+
+    /// 8バイトずつ読み込んで混ぜる、暗号用ではない高速なハッシュ関数です
+    static uint64_t hashBytes(const void* data, std::size_t n, uint64_t h)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for(; n >= 8; p += 8, n -= 8){
+            uint64_t w;
+            std::memcpy(&w, p, 8);
+            h = (h ^ mix64(w)) * 0x9e3779b97f4a7c15ULL;
+            h = (h << 31) | (h >> 33);
+        }
+
+        uint64_t w = n;
+        std::memcpy(&w, p, n);
+        return (h ^ mix64(w ^ (uint64_t(n) << 56))) * 0x9e3779b97f4a7c15ULL;
+    }
+
+
+    static uint64_t align8(uint64_t n) { return (n + 7) / 8 * 8; }
+
+
+    boost::optional<CachedProblemData> find(DividedImageView img, uint64_t fp) const
+    {
+        const auto path = pathOf(fp);
+        if(!std::ifstream(path))
+            return boost::none;
+
+        std::shared_ptr<MappedFile> file;
+        try{
+            file = std::make_shared<MappedFile>(path);
+        }
+        catch(std::exception&){
+            return boost::none;
+        }
+
+        Header h;
+        if(file->size() < sizeof(h))
+            return boost::none;
+        std::memcpy(&h, file->data(), sizeof(h));
+
+        const std::size_t ww = img.width() / img.div_x(),
+                          hh = img.height() / img.div_y(),
+                          n = img.div_x() * img.div_y();
+
+        if(std::memcmp(h.magic, magic(), 8) != 0 || h.fingerprint != fp
+        || h.div_x != img.div_x() || h.div_y != img.div_y()
+        || h.fragmentWidth != ww || h.fragmentHeight != hh
+        || h.edgesBytes != (ww + hh) * 2 * 3 * n || h.costsValues != n * n * 4
+        || h.edgesOffset + h.edgesBytes > file->size()
+        || h.costsOffset % alignof(float) != 0
+        || h.costsOffset + h.costsValues * sizeof(float) > file->size())
+            return boost::none;
+
+        // 配列の寿命はマップしたファイルの寿命と同じにする
+        std::shared_ptr<const uint8_t> edges(file, file->data() + h.edgesOffset);
+        std::shared_ptr<const float> costs(file, reinterpret_cast<const float*>(file->data() + h.costsOffset));
+
+        return CachedProblemData{fp, FragmentEdges(h.div_x, h.div_y, ww, hh, edges), CostTable(n, costs)};
+    }
+
+
+    static void write(std::string const & path, uint64_t fp, FragmentEdges const & edges, CostTable const & costs)
+    {
+        Header h = {};
+        std::memcpy(h.magic, magic(), 8);
+        h.fingerprint = fp;
+        h.div_x = edges.div_x();
+        h.div_y = edges.div_y();
+        h.fragmentWidth = edges.fragment_width();
+        h.fragmentHeight = edges.fragment_height();
+        h.edgesOffset = sizeof(Header);
+        h.edgesBytes = edges.bytes();
+        h.costsOffset = align8(h.edgesOffset + h.edgesBytes);
+        h.costsValues = costs.values();
+
+        const std::string tmp = text(path, ".tmp", std::random_device()());
+        {
+            std::ofstream ofs(tmp, std::ios::binary);
+            PROCON_ENFORCE(ofs, format("cannot open %", tmp));
+
+            const char zeros[8] = {};
+            ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            ofs.write(reinterpret_cast<const char*>(edges.data()), h.edgesBytes);
+            ofs.write(zeros, h.costsOffset - (h.edgesOffset + h.edgesBytes));
+            ofs.write(reinterpret_cast<const char*>(costs.data()), h.costsValues * sizeof(float));
+            PROCON_ENFORCE(ofs, format("cannot write %", tmp));
+        }
+
+        if(std::rename(tmp.c_str(), path.c_str()) != 0){
+            std::remove(tmp.c_str());
+            PROCON_ENFORCE(false, format("cannot rename % to %", tmp, path));
+        }
+    }
+};
+
+}} // namespace procon::utils
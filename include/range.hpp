@@ -2,43 +2,297 @@
 
 #include "template.hpp"
 #include <cmath>
+#include <cstddef>
 #include <algorithm>
+#include <array>
+#include <exception>
+#include <iterator>
 #include <type_traits>
-#include <boost/range/irange.hpp>
 #include "exception.hpp"
 #include "dwrite.hpp"
 
 
+/**
+レンジの引数の検査はデバッグビルドでのみ行います。
+`NDEBUG`が定義されている場合は何もしないので、ホットなループの中で使ってもコストはかかりません。
+*/
+#ifdef NDEBUG
+#define PROCON_RANGE_CHECK(b, msg) ((void)0)
+#else
+#define PROCON_RANGE_CHECK(b, msg) ((b) ? (void)0 : procon::utils::rangeError(msg, __FILE__, __LINE__))
+#endif
+
+
 namespace procon { namespace utils {
 
-// 互換性を残すために、boost::irangeのラッパとする
+[[noreturn]] inline void rangeError(const char* msg, const char* fname, std::size_t line)
+{
+    enforce_(false, msg, fname, line);
+    std::terminate();   // enforce_が例外を投げるので、ここには来ない
+}
+
+
+/** [a, b)を1ずつ進む数列です。
+イテレータは`std::size_t`を1つ持つだけなので、自明にコピー可能です。
+*/
+class IotaRange
+{
+  public:
+    struct iterator
+    {
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef std::size_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::size_t* pointer;
+        typedef std::size_t reference;
+
+        constexpr iterator() : _v(0) {}
+        constexpr explicit iterator(std::size_t v) : _v(v) {}
+
+        constexpr std::size_t operator*() const { return _v; }
+        constexpr std::size_t operator[](difference_type n) const { return _v + n; }
+
+        constexpr iterator& operator++() { ++_v; return *this; }
+        constexpr iterator& operator--() { --_v; return *this; }
+        constexpr iterator operator++(int) { auto dst = *this; ++_v; return dst; }
+        constexpr iterator operator--(int) { auto dst = *this; --_v; return dst; }
+        constexpr iterator& operator+=(difference_type n) { _v += n; return *this; }
+        constexpr iterator& operator-=(difference_type n) { _v -= n; return *this; }
+        constexpr iterator operator+(difference_type n) const { return iterator(_v + n); }
+        constexpr iterator operator-(difference_type n) const { return iterator(_v - n); }
+        constexpr difference_type operator-(iterator const & other) const { return static_cast<difference_type>(_v - other._v); }
+
+        constexpr bool operator==(iterator const & other) const { return _v == other._v; }
+        constexpr bool operator!=(iterator const & other) const { return _v != other._v; }
+        constexpr bool operator<(iterator const & other) const { return _v < other._v; }
+        constexpr bool operator>(iterator const & other) const { return _v > other._v; }
+        constexpr bool operator<=(iterator const & other) const { return _v <= other._v; }
+        constexpr bool operator>=(iterator const & other) const { return _v >= other._v; }
+
+      private:
+        std::size_t _v;
+    };
+
+    typedef iterator const_iterator;
+    typedef std::size_t value_type;
+
+
+    constexpr IotaRange(std::size_t a, std::size_t b) : _a(a), _b(b)
+    {
+        PROCON_RANGE_CHECK(a <= b, "invalid range");
+    }
+
+
+    constexpr iterator begin() const { return iterator(_a); }
+    constexpr iterator end() const { return iterator(_b); }
+    constexpr std::size_t size() const { return _b - _a; }
+    constexpr bool empty() const { return _a == _b; }
+    constexpr std::size_t front() const { return _a; }
+    constexpr std::size_t back() const { return _b - 1; }
+    constexpr std::size_t operator[](std::size_t i) const { return _a + i; }
+
+
+  private:
+    std::size_t _a;
+    std::size_t _b;
+};
+
+
+/** 公差`step`の数列です。`step`は負でも構いません。
+要素数を先に計算しておき、末尾の値は`front() + size() * step`にそろえます。
+*/
+class StridedRange
+{
+  public:
+    struct iterator
+    {
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef std::size_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::size_t* pointer;
+        typedef std::size_t reference;
+
+        constexpr iterator() : _v(0), _step(1) {}
+        constexpr iterator(std::size_t v, std::ptrdiff_t step) : _v(v), _step(step) {}
+
+        constexpr std::size_t operator*() const { return _v; }
+        constexpr std::size_t operator[](difference_type n) const { return _v + n * _step; }
+
+        constexpr iterator& operator++() { _v += _step; return *this; }
+        constexpr iterator& operator--() { _v -= _step; return *this; }
+        constexpr iterator operator++(int) { auto dst = *this; _v += _step; return dst; }
+        constexpr iterator operator--(int) { auto dst = *this; _v -= _step; return dst; }
+        constexpr iterator& operator+=(difference_type n) { _v += n * _step; return *this; }
+        constexpr iterator& operator-=(difference_type n) { _v -= n * _step; return *this; }
+        constexpr iterator operator+(difference_type n) const { return iterator(_v + n * _step, _step); }
+        constexpr iterator operator-(difference_type n) const { return iterator(_v - n * _step, _step); }
+        constexpr difference_type operator-(iterator const & other) const { return static_cast<difference_type>(_v - other._v) / _step; }
+
+        constexpr bool operator==(iterator const & other) const { return _v == other._v; }
+        constexpr bool operator!=(iterator const & other) const { return _v != other._v; }
+        constexpr bool operator<(iterator const & other) const { return (other - *this) > 0; }
+        constexpr bool operator>(iterator const & other) const { return other < *this; }
+        constexpr bool operator<=(iterator const & other) const { return !(other < *this); }
+        constexpr bool operator>=(iterator const & other) const { return !(*this < other); }
+
+      private:
+        std::size_t _v;
+        std::ptrdiff_t _step;
+    };
+
+    typedef iterator const_iterator;
+    typedef std::size_t value_type;
+
+
+    constexpr StridedRange(std::size_t a, std::size_t b, std::ptrdiff_t step)
+    : _a(a), _step(step), _n(0)
+    {
+        PROCON_RANGE_CHECK(step != 0, "step is 0");
+        PROCON_RANGE_CHECK(step > 0 ? a <= b : a >= b, "invalid range");
+
+        _n = step > 0 ? (b - a + step - 1) / step
+                      : (a - b + (-step) - 1) / (-step);
+    }
+
+
+    /// 初項、公差、要素数から構築します
+    static constexpr StridedRange withSize(std::size_t first, std::ptrdiff_t step, std::size_t n)
+    {
+        return StridedRange(first, step, n, 0);
+    }
+
+
+    constexpr iterator begin() const { return iterator(_a, _step); }
+    constexpr iterator end() const { return iterator(_a + _n * _step, _step); }
+    constexpr std::size_t size() const { return _n; }
+    constexpr bool empty() const { return _n == 0; }
+    constexpr std::size_t front() const { return _a; }
+    constexpr std::size_t back() const { return _a + (_n - 1) * _step; }
+    constexpr std::size_t operator[](std::size_t i) const { return _a + i * _step; }
+    constexpr std::ptrdiff_t step() const { return _step; }
+
+
+  private:
+    std::size_t _a;
+    std::ptrdiff_t _step;
+    std::size_t _n;
+
+
+    constexpr StridedRange(std::size_t a, std::ptrdiff_t step, std::size_t n, int)
+    : _a(a), _step(step), _n(n) {}
+};
+
+
+/** rows行cols列の2次元インデックスを、行優先で`Index2D`(`std::array<std::size_t, 2>`)として列挙します。
+
+Example:
+------------
+for(auto idx: grid_range(pb.div_y(), pb.div_x()))
+    writeln(idx);       // [0, 0], [0, 1], ...
+------------
+*/
+class GridRange
+{
+  public:
+    struct iterator
+    {
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::array<std::size_t, 2> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef value_type reference;
+
+        constexpr iterator() : _i(0), _j(0), _cols(1) {}
+        constexpr iterator(std::size_t i, std::size_t j, std::size_t cols) : _i(i), _j(j), _cols(cols) {}
+
+        constexpr value_type operator*() const { return value_type{{_i, _j}}; }
+
+        constexpr iterator& operator++()
+        {
+            if(++_j == _cols){
+                _j = 0;
+                ++_i;
+            }
+            return *this;
+        }
+
+        constexpr iterator operator++(int) { auto dst = *this; ++*this; return dst; }
+
+        constexpr bool operator==(iterator const & other) const { return _i == other._i && _j == other._j; }
+        constexpr bool operator!=(iterator const & other) const { return !(*this == other); }
+
+      private:
+        std::size_t _i;
+        std::size_t _j;
+        std::size_t _cols;
+    };
+
+    typedef iterator const_iterator;
+    typedef std::array<std::size_t, 2> value_type;
+
+
+    constexpr GridRange(std::size_t rows, std::size_t cols) : _rows(cols ? rows : 0), _cols(cols) {}
+
+
+    constexpr iterator begin() const { return iterator(0, 0, _cols); }
+    constexpr iterator end() const { return iterator(_rows, 0, _cols); }
+    constexpr std::size_t size() const { return _rows * _cols; }
+    constexpr bool empty() const { return size() == 0; }
+    constexpr std::size_t rows() const { return _rows; }
+    constexpr std::size_t cols() const { return _cols; }
+
+
+  private:
+    std::size_t _rows;
+    std::size_t _cols;
+};
+
+
+static_assert(std::is_trivially_copyable<IotaRange::iterator>::value, "");
+static_assert(std::is_trivially_copyable<StridedRange::iterator>::value, "");
+static_assert(std::is_trivially_copyable<GridRange::iterator>::value, "");
+
+
 /** [a, b)の範囲の数列を生成します
 */
-auto iota(size_t a, size_t b, ptrdiff_t step)
--> decltype(boost::irange(a, b, step))
+constexpr StridedRange iota(std::size_t a, std::size_t b, std::ptrdiff_t step)
 {
-    PROCON_ENFORCE(step != 0, "step is 0");
-    PROCON_ENFORCE(step > 0 ? a <= b : a >= b, "invalid range");
+    return StridedRange(a, b, step);
+}
+
 
-    return boost::irange(a, b, step);
+/// ditto
+constexpr IotaRange iota(std::size_t a, std::size_t b)
+{
+    return IotaRange(a, b);
+}
+
+
+/// [0, 1, 2, ..., a-1] という数列を生成します
+constexpr IotaRange iota(std::size_t a)
+{
+    return IotaRange(0, a);
 }
 
 
 /// ditto
-auto iota(size_t a, size_t b)
--> decltype(boost::irange(a, b))
+constexpr GridRange grid_range(std::size_t rows, std::size_t cols)
 {
-    PROCON_ENFORCE(a <= b, "invalid range [%, %)");
+    return GridRange(rows, cols);
+}
 
-    return boost::irange(a, b);
+
+/// 数列を逆順にします
+constexpr StridedRange reversed(IotaRange const & r)
+{
+    return StridedRange::withSize(r.empty() ? 0 : r.back(), -1, r.size());
 }
 
 
-/// [0, 1, 2, ..., a-1] という数列を生成します
-auto iota(size_t a)
--> decltype(iota(0, a))
+/// ditto
+constexpr StridedRange reversed(StridedRange const & r)
 {
-    return iota(0, a);
+    return StridedRange::withSize(r.empty() ? 0 : r.back(), -r.step(), r.size());
 }
 
 
@@ -56,4 +310,4 @@ bool equal(T const & t, U const & u)
 }
 
 
-}}
\ No newline at end of file
+}}
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include <boost/optional.hpp>
+#include "image.hpp"
+#include "types.hpp"
+#include "answer.hpp"
+#include "arrangement.hpp"
+#include "expected.hpp"
+#include "exception.hpp"
+#include "dwrite.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 回答の1手です。選択操作か、交換操作のどちらかです。
+*/
+struct ReplayStep
+{
+    bool isSelect;
+    Position pos;           // 選択操作の場合の選択位置
+    Direction dir;          // 交換操作の場合の方向
+
+
+    void to_string(std::ostream& s) const
+    {
+        if(isSelect)
+            s << "select " << encodeAnswerPosition(pos);
+        else
+            s << toChar(dir);
+    }
+};
+
+
+/** 回答をn手目まで適用した時点の状態です。
+*/
+struct ReplayState
+{
+    Arrangement arrangement;
+    boost::optional<Position> selected;     // 1回も選択していなければnone
+    std::size_t cost;                       // n手目までのコスト
+};
+
+
+/** 回答を1手ずつの操作の列にします。
+盤面の外の選択位置や、不正な交換操作の文字を含む場合は例外を投げます。
+*/
+inline std::vector<ReplayStep> toReplaySteps(Answer const & ans, std::size_t div_x, std::size_t div_y)
+{
+    std::vector<ReplayStep> dst;
+    for(auto& op: ans){
+        const Position p(op.select);
+        PROCON_ENFORCE(p.inside(div_x, div_y), format("selected position % is out of the image", p));
+        dst.push_back(ReplayStep{true, p, Direction::right});
+
+        for(char c: op.moves){
+            PROCON_ENFORCE(isDirectionChar(c), format("invalid change: %", c));
+            dst.push_back(ReplayStep{false, p, toDirection(c)});
+        }
+    }
+
+    return dst;
+}
+
+
+/** 状態に1手適用します。
+選択前の交換操作や、盤面の外に出る交換操作の場合は、状態を変更せずにエラーを返します。
+再生の1手ごとに呼ばれるので、例外は投げません。
+*/
+inline Expected<void> applyReplayStep(ReplayState& s, ReplayStep const & st, std::size_t div_x, std::size_t div_y, int select_cost, int change_cost)
+{
+    if(st.isSelect){
+        s.selected = st.pos;
+        s.cost += select_cost;
+        return {};
+    }
+
+    PROCON_CHECK(s.selected, "change before selection");
+
+    const Position next = s.selected->moved(st.dir);
+    PROCON_CHECK(next.inside(div_x, div_y), "change moves out of the image");
+
+    s.arrangement.swap_element(*s.selected, next);
+    s.selected = next;
+    s.cost += change_cost;
+    return {};
+}
+
+
+/** 回答を1手ずつ再生します。
+構築時に回答全体を1回だけ再生し、`interval`手ごとに状態(断片の配置と選択位置)を保存しておくので、
+任意の手数への移動は、直前の保存点からの高々`interval`手の再生で済みます。
+
+手数nの状態は、先頭からn手(選択操作も1手と数えます)を適用した状態で、nは0から`size()`までです。
+
+Example:
+------------
+Replay replay(pb, readAnswer(std::cin));
+
+replay.seek(1000);                  // 1000手目へ
+replay.prev();                      // 999手目へ
+writeln(replay.state().arrangement);
+
+// 断片(0, 0)が正しい位置にある状態が、最初に崩れる手数を求める
+auto n = replay.bisect([](ReplayState const & s){ return s.arrangement(0, 0) == ImageID(0, 0); });
+------------
+*/
+class Replay
+{
+  public:
+    /** 盤面の外に出る交換操作や、盤面の外の選択位置を含む場合は例外を投げます。
+    */
+    Replay(std::size_t div_x, std::size_t div_y, Answer const & ans,
+           int select_cost = 0, int change_cost = 0, std::size_t interval = 64)
+    : _div_x(div_x), _div_y(div_y), _select_cost(select_cost), _change_cost(change_cost),
+      _interval(std::max<std::size_t>(interval, 1)),
+      _steps(toReplaySteps(ans, div_x, div_y)), _pos(0), _cur{Arrangement(div_x, div_y), boost::none, 0}
+    {
+        // 全体を1回再生して保存点を作る
+        _snapshots.push_back(_cur);
+        while(_pos < _steps.size()){
+            apply(_cur, _steps[_pos]).onFailure([&](ErrorInfo const & e){
+                PROCON_ENFORCE(false, format("step %: %", _pos, e.msg));
+            });
+            ++_pos;
+
+            if(_pos % _interval == 0)
+                _snapshots.push_back(_cur);
+        }
+
+        seek(0);
+    }
+
+
+    Replay(Problem const & pb, Answer const & ans, std::size_t interval = 64)
+    : Replay(pb.div_x(), pb.div_y(), ans, pb.select_cost(), pb.change_cost(), interval)
+    {}
+
+
+    /// 全体の手数
+    std::size_t size() const { return _steps.size(); }
+
+
+    /// 現在の手数
+    std::size_t position() const { return _pos; }
+
+
+    /// 現在の状態
+    ReplayState const & state() const { return _cur; }
+
+
+    /// n手目 (0始まり) の操作
+    ReplayStep const & step(std::size_t n) const { return _steps[n]; }
+
+
+    /// 手数nの状態に移動します
+    void seek(std::size_t n)
+    {
+        PROCON_ENFORCE(n <= size(), format("step % is out of the answer (% steps)", n, size()));
+
+        // 保存点を通り過ぎずに進めるなら、今の状態から進める
+        if(!(_pos <= n && n / _interval == _pos / _interval)){
+            _cur = _snapshots[n / _interval];
+            _pos = n / _interval * _interval;
+        }
+
+        for(; _pos < n; ++_pos)
+            apply(_cur, _steps[_pos]);
+    }
+
+
+    /// 1手進めます。最後の手数にいる場合はfalseを返します。
+    bool next()
+    {
+        if(_pos == size())
+            return false;
+
+        apply(_cur, _steps[_pos++]);
+        return true;
+    }
+
+
+    /// 1手戻ります。最初にいる場合はfalseを返します。
+    bool prev()
+    {
+        if(_pos == 0)
+            return false;
+
+        seek(_pos - 1);
+        return true;
+    }
+
+
+    /** `pred(state)`が最初に偽になる手数を二分探索で求めます。
+    `pred`はある手数までは真で、それ以降は偽であると仮定します。
+    最後まで真の場合は`boost::none`を返します。現在の手数は、見つかった手数か最後の手数になります。
+    */
+    template <typename F>
+    boost::optional<std::size_t> bisect(F pred)
+    {
+        // 保存点について二分探索してから、保存点の間を順に調べる
+        std::size_t lo = 0, hi = _snapshots.size();
+        while(lo < hi){
+            const std::size_t mid = (lo + hi) / 2;
+            if(pred(_snapshots[mid]))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if(lo == 0){
+            seek(0);
+            return std::size_t(0);
+        }
+
+        const std::size_t from = (lo - 1) * _interval,
+                          to = std::min(lo * _interval, size());
+        seek(from);
+        while(_pos < to){
+            next();
+            if(!pred(_cur))
+                return _pos;
+        }
+
+        return boost::none;
+    }
+
+
+  private:
+    std::size_t _div_x;
+    std::size_t _div_y;
+    int _select_cost;
+    int _change_cost;
+    std::size_t _interval;
+    std::vector<ReplayStep> _steps;
+    std::vector<ReplayState> _snapshots;    // _snapshots[k]は手数 k * _interval の状態
+    std::size_t _pos;
+    ReplayState _cur;
+
+
+    Expected<void> apply(ReplayState& s, ReplayStep const & st) const
+    {
+        return applyReplayStep(s, st, _div_x, _div_y, _select_cost, _change_cost);
+    }
+};
+
+}} // namespace procon::utils
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include "image.hpp"
+#include "types.hpp"
+#include "range.hpp"
+#include "cost_table.hpp"
+#include "arena.hpp"
+#include "thread_pool.hpp"
+#include "exception.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 断片を帯(行または列)にまとめてから、帯どうしを継ぎ合わせて全体を復元します。
+
+盤面全体に1つずつ断片を置いていく貪欲法は、16x16のように大きな盤面では遅く、誤りも広がりやすくなります。
+ここでは次の2段階で復元します。
+
++ 帯の組み立て: 残っている全ての断片を種として、種から左右(列なら上下)に最も相性の良い断片を付け足して帯を作ります。
+  相性は、接合部のコストをその辺での2番目に小さいコストで割った値で比べるので、どの断片とも合う平坦な辺より、
+  特定の断片とだけよく合う辺が優先されます。
+  種ごとに独立なので並列に計算し、相性の和が最小の帯を採用します。これを全ての断片が帯に入るまで繰り返します。
++ 帯の継ぎ合わせ: 帯どうしの相性(並べたときの接合部のコストの和)から、全ての帯を縦(列なら横)に並べる順を貪欲に決めます。
+  全ての帯を先頭にした場合を試し、最も良い並べ方を採用します。
+
+行と列の両方で復元し、接合部のコストの総和が小さい方を返します。
+結果はそのまま`SwappedImage`に渡せます。元の向きの断片のみを扱います。
+
+Example:
+------------
+StripAssembler assembler(pb.view(), CostTable(pb.view()));
+SwappedImage restored(pb.dividedImage(), assembler.assemble());
+------------
+*/
+class StripAssembler
+{
+  public:
+    StripAssembler(DividedImageView img, CostTable const & costs)
+    : _costs(costs), _div_x(img.div_x()), _div_y(img.div_y()), _second(img.div_x() * img.div_y() * 4)
+    {
+        const std::size_t n = _div_x * _div_y;
+        PROCON_ENFORCE(costs.size() == n, "the cost table does not belong to the image");
+
+        std::vector<Scratch> scratch(defaultThreadPool().size() + 1);
+        defaultThreadPool().parallel_for(iota(n), [&](std::size_t a){
+            const CostTableView local = localScratch(scratch).costs;
+            for(int d = 0; d < 4; ++d){
+                float first = std::numeric_limits<float>::infinity(),
+                      second = first;
+
+                for(std::size_t b = 0; b < n; ++b){
+                    if(b == a)
+                        continue;
+
+                    const float c = local.cost(a, b, static_cast<Direction>(d));
+                    if(c < first){ second = first; first = c; }
+                    else if(c < second) second = c;
+                }
+
+                _second[a * 4 + d] = second;
+            }
+        });
+    }
+
+
+    /// 行と列の両方で復元し、接合部のコストの総和が小さい方を返します
+    std::vector<std::vector<ImageID>> assemble() const
+    {
+        auto rows = assemble(false),
+             cols = assemble(true);
+
+        return totalCost(rows) <= totalCost(cols) ? rows : cols;
+    }
+
+
+    /// `columns`がfalseなら行の帯、trueなら列の帯から復元します
+    std::vector<std::vector<ImageID>> assemble(bool columns) const
+    {
+        const Axis ax = axis(columns);
+        const auto strips = makeStrips(ax);
+        const auto order = stitch(ax, strips);
+
+        std::vector<std::vector<ImageID>> dst(_div_y, std::vector<ImageID>(_div_x));
+        for(auto s: iota(order.size()))
+            for(auto k: iota(ax.length)){
+                const std::size_t f = strips[order[s]][k];
+                const std::size_t r = columns ? k : s,
+                                  c = columns ? s : k;
+                dst[r][c] = ImageID(f / _div_x, f % _div_x);
+            }
+
+        return dst;
+    }
+
+
+    /// 配置の、隣接する全ての断片の組の接合部のコストの和を返します
+    double totalCost(std::vector<std::vector<ImageID>> const & idx) const
+    {
+        double sum = 0;
+        for(auto i: iota(_div_y))
+            for(auto j: iota(_div_x)){
+                const std::size_t a = flatten(idx[i][j]);
+                if(j + 1 < _div_x) sum += _costs.cost(a, flatten(idx[i][j + 1]), Direction::right);
+                if(i + 1 < _div_y) sum += _costs.cost(a, flatten(idx[i + 1][j]), Direction::down);
+            }
+
+        return sum;
+    }
+
+
+  private:
+    typedef std::vector<std::size_t> Strip;     // 帯に並んだ断片の番号
+
+    /// `parallel_for`の中で使う、ワーカーごとの作業領域
+    struct Scratch
+    {
+        CostTableView costs;    // ワーカーのNUMAノードにある表の複製 (最初に使うときに選ぶ)
+        MonotonicArena arena;   // growStripの作業領域
+    };
+
+    /// 帯を伸ばす方向と、帯を並べる方向
+    struct Axis
+    {
+        Direction along;
+        Direction across;
+        std::size_t length;     // 帯の長さ
+        std::size_t count;      // 帯の数
+    };
+
+    CostTable _costs;
+    std::size_t _div_x;
+    std::size_t _div_y;
+    std::vector<float> _second;     // _second[a * 4 + d]は、断片aの方向dの辺での2番目に小さいコスト
+
+
+    std::size_t flatten(ImageID id) const { return id.get_position().flatten(_div_x); }
+
+
+    Axis axis(bool columns) const
+    {
+        if(columns)
+            return Axis{Direction::down, Direction::right, _div_y, _div_x};
+        else
+            return Axis{Direction::right, Direction::down, _div_x, _div_y};
+    }
+
+
+    /// 全ての断片を、互いに素な帯に分けます
+    std::vector<Strip> makeStrips(Axis const & ax) const
+    {
+        const std::size_t n = _div_x * _div_y;
+        std::vector<char> used(n, 0);
+        std::vector<Strip> dst;
+
+        std::vector<Strip> candidates(n);
+        std::vector<double> scores(n);
+        std::vector<Scratch> scratch(defaultThreadPool().size() + 1);
+        while(dst.size() < ax.count){
+            // 種ごとに帯を伸ばす
+            defaultThreadPool().parallel_for(iota(n), [&](std::size_t seed){
+                candidates[seed].clear();
+                scores[seed] = std::numeric_limits<double>::infinity();
+                if(!used[seed])
+                    scores[seed] = growStrip(localScratch(scratch), ax, seed, used, candidates[seed]);
+            });
+
+            const std::size_t best = std::min_element(scores.begin(), scores.end()) - scores.begin();
+            for(auto f: candidates[best])
+                used[f] = 1;
+
+            dst.push_back(std::move(candidates[best]));
+        }
+
+        return dst;
+    }
+
+
+    /// 呼び出したワーカーの作業領域を返します。表の複製は、ワーカーごとに最初の1回だけ選びます。
+    Scratch& localScratch(std::vector<Scratch>& scratch) const
+    {
+        Scratch& s = scratch[defaultThreadPool().workerIndex()];
+        if(!s.costs.data())
+            s.costs = _costs.forCurrentNode();
+
+        return s;
+    }
+
+
+    /// 断片bを断片aの方向dに置いたときの、2番目に小さいコストで正規化した相性
+    double affinity(CostTableView costs, std::size_t a, std::size_t b, Direction d) const
+    {
+        return costs.cost(a, b, d) / (_second[a * 4 + static_cast<int>(d)] + 1.0);
+    }
+
+
+    /** `seed`から帯を伸ばし、相性の和を返します。
+    両端のうち、付け足す断片との相性が良い方に1つずつ伸ばします。
+    `scratch`は呼び出したワーカーの作業領域で、アリーナは呼び出すたびに巻き戻します。
+    */
+    double growStrip(Scratch& scratch, Axis const & ax, std::size_t seed, std::vector<char> const & used, Strip& dst) const
+    {
+        const std::size_t n = used.size();
+        const CostTableView costs = scratch.costs;
+        MonotonicArena& arena = scratch.arena;
+        arena.reset();
+        ArenaVector<char> taken(used.begin(), used.end(), ArenaAllocator<char>(arena));
+        taken[seed] = 1;
+
+        // 両端に伸ばすので、種を中央に置いた長さ2 * lengthの領域の[head, tail)を帯とする
+        ArenaVector<std::size_t> strip(ax.length * 2, 0, ArenaAllocator<std::size_t>(arena));
+        std::size_t head = ax.length, tail = ax.length + 1;
+        strip[head] = seed;
+
+        double sum = 0;
+        while(tail - head < ax.length){
+            double bestCost = std::numeric_limits<double>::infinity();
+            std::size_t bestFrag = n;
+            bool front = false;
+
+            for(std::size_t f = 0; f < n; ++f){
+                if(taken[f])
+                    continue;
+
+                const double back = affinity(costs, strip[tail - 1], f, ax.along),
+                             first = affinity(costs, strip[head], f, opposite(ax.along));
+                if(back < bestCost){ bestCost = back; bestFrag = f; front = false; }
+                if(first < bestCost){ bestCost = first; bestFrag = f; front = true; }
+            }
+
+            PROCON_ENFORCE(bestFrag != n, "not enough fragments to make a strip");
+            if(front)
+                strip[--head] = bestFrag;
+            else
+                strip[tail++] = bestFrag;
+
+            taken[bestFrag] = 1;
+            sum += bestCost;
+        }
+
+        dst.assign(strip.begin() + head, strip.begin() + tail);
+        return sum;
+    }
+
+
+    /// 帯sの次に帯tを並べたときの接合部のコストの和
+    double stripCost(Axis const & ax, Strip const & s, Strip const & t) const
+    {
+        double sum = 0;
+        for(auto k: iota(ax.length))
+            sum += _costs.cost(s[k], t[k], ax.across);
+
+        return sum;
+    }
+
+
+    /// 帯を並べる順を決めます
+    std::vector<std::size_t> stitch(Axis const & ax, std::vector<Strip> const & strips) const
+    {
+        const std::size_t m = strips.size();
+        std::vector<double> pair(m * m);
+        for(auto s: iota(m))
+            for(auto t: iota(m))
+                pair[s * m + t] = s == t ? 0 : stripCost(ax, strips[s], strips[t]);
+
+        std::vector<std::size_t> best;
+        double bestSum = std::numeric_limits<double>::infinity();
+        for(auto first: iota(m)){
+            std::vector<std::size_t> order{first};
+            std::vector<char> taken(m, 0);
+            taken[first] = 1;
+
+            double sum = 0;
+            while(order.size() < m){
+                std::size_t next = m;
+                for(auto t: iota(m))
+                    if(!taken[t] && (next == m || pair[order.back() * m + t] < pair[order.back() * m + next]))
+                        next = t;
+
+                sum += pair[order.back() * m + next];
+                taken[next] = 1;
+                order.push_back(next);
+            }
+
+            if(sum < bestSum){
+                bestSum = sum;
+                best = std::move(order);
+            }
+        }
+
+        return best;
+    }
+};
+
+}} // namespace procon::utils
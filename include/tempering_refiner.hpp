@@ -0,0 +1,528 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "image.hpp"
+#include "types.hpp"
+#include "range.hpp"
+#include "cost_table.hpp"
+#include "arrangement.hpp"
+#include "arrangement_scorer.hpp"
+#include "anytime_solver.hpp"
+#include "exception.hpp"
+
+
+namespace procon { namespace utils {
+
+/** 復元した配置を、レプリカ交換法(parallel tempering)による焼きなましで改善します。
+
+温度の異なる複数のレプリカを、それぞれ別のスレッドで動かします。
+各レプリカは`ArrangementScorer`で接合部のコストの総和を差分更新しながら、次の近傍を試します。
+
++ 2つの断片の交換
++ 2つの重ならない矩形ブロック(最大3x3)の交換
++ 行または列の一部(最大8断片)を1つずらす巡回シフト
+
+ブロックの交換とシフトは`swap_element`の列として適用し、棄却したら逆順に戻します。1回の交換はO(1)です。
+レプリカどうしは`exchangeInterval`回の試行ごとにだけ同期し、隣り合う温度のレプリカの温度を確率的に交換します。
+それ以外の間はロックを取りません。
+期限になるか停止が要求されると、全てのレプリカを通じて最も良かった配置を返します。
+
+前回の`refine`が返した配置をそのまま渡した場合は、レプリカ(配置、温度、乱数の状態)とスレッドを引き継いで続きから探索するので、
+短い時間ずつ繰り返し呼んでも、毎回同じ探索を繰り返したり温度を推定しなおしたりしません。
+それ以外の配置を渡した場合や設定を変えた場合は、呼び出し回数を混ぜた種でレプリカを作りなおします。
+
+Example:
+------------
+TemperingRefiner refiner(pb);
+auto idx = StripAssembler(pb.view(), CostTable(pb.view())).assemble();
+idx = refiner.refine(idx, std::chrono::seconds(5));
+writeln(refiner.bestScore());
+------------
+*/
+class TemperingRefiner
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+
+    TemperingRefiner(DividedImage const & img, CostTable const & costs)
+    : _img(img), _costs(costs),
+      _replicas(std::max<std::size_t>(std::thread::hardware_concurrency(), 2)),
+      _tMin(0), _tMax(0), _exchangeInterval(4096), _seed(std::random_device()()),
+      _bestScore(0), _exchanges(0), _acceptedExchanges(0), _calls(0), _epochs(0)
+    {}
+
+
+    explicit TemperingRefiner(Problem const & pb)
+    : TemperingRefiner(pb.dividedImage(), CostTable(pb.view())) {}
+
+
+    TemperingRefiner(TemperingRefiner const &) = delete;
+    TemperingRefiner& operator=(TemperingRefiner const &) = delete;
+
+
+    ~TemperingRefiner() { shutdown(); }
+
+
+    /// レプリカの数 (スレッド数) を指定します。デフォルトはハードウェアのスレッド数です。
+    void setReplicas(std::size_t n)
+    {
+        shutdown();
+        _replicas = std::max<std::size_t>(n, 1);
+    }
+
+
+    /** 最低と最高の温度を指定します。間の温度は等比に決めます。
+    指定しない場合は、初期配置でのランダムな交換によるコストの変化量の平均を最高温度、その1/1000を最低温度にします。
+    */
+    void setTemperatures(double tMin, double tMax)
+    {
+        PROCON_ENFORCE(0 < tMin && tMin <= tMax, "invalid temperatures");
+        shutdown();
+        _tMin = tMin;
+        _tMax = tMax;
+    }
+
+
+    /// レプリカ交換を行う間隔(各レプリカの試行回数)を指定します
+    void setExchangeInterval(std::size_t n)
+    {
+        shutdown();
+        _exchangeInterval = std::max<std::size_t>(n, 1);
+    }
+
+
+    void setSeed(uint64_t seed)
+    {
+        shutdown();
+        _seed = seed;
+    }
+
+
+    /// 直前の`refine`で得られた最良の配置のコストの総和
+    double bestScore() const { return _bestScore; }
+
+    /// 直前の`refine`での、レプリカ交換の試行回数と成功回数
+    std::size_t exchanges() const { return _exchanges; }
+    std::size_t acceptedExchanges() const { return _acceptedExchanges; }
+
+
+    /** `idx`から始めて、期限になるか`stopped()`がtrueを返すまで改善し、最良の配置を返します。
+    `idx`が前回の結果と同じなら、前回のレプリカの続きから探索します。
+    いずれかのレプリカが例外を投げた場合は、全スレッドを終了してからその例外を投げなおします。
+    */
+    std::vector<std::vector<ImageID>> refine(std::vector<std::vector<ImageID>> const & idx, Clock::time_point deadline,
+                                             std::function<bool()> stopped = nullptr)
+    {
+        ++_calls;
+        if(!_sync || idx != _lastBest)
+            restart(idx);
+
+        Sync& sync = *_sync;
+        const std::size_t nReplicas = _rs.size();
+        std::exception_ptr ex;
+        {
+            std::unique_lock<std::mutex> lock(sync.mutex);
+            _deadline = deadline;
+            _stopped = std::move(stopped);
+            _exchanges = _acceptedExchanges = 0;
+
+            while(1){
+                // レプリカを次の区間まで進める
+                sync.arrived = 0;
+                ++sync.epoch;
+                sync.workers.notify_all();
+                sync.coordinator.wait(lock, [&]{ return sync.arrived == nReplicas; });
+
+                // 全てのレプリカが待っている間に、誤差の蓄積を除いて温度を交換する
+                for(auto& rep: _rs)
+                    rep->scorer.rescore();
+
+                exchange(_rs, _epochs++ & 1, _exchangeRng);
+
+                if(sync.ex || finished())
+                    break;
+            }
+
+            ex = sync.ex;
+            _stopped = nullptr;
+        }
+
+        if(ex){
+            shutdown();
+            std::rethrow_exception(ex);
+        }
+
+        auto best = std::min_element(_rs.begin(), _rs.end(), [](std::unique_ptr<Replica> const & a, std::unique_ptr<Replica> const & b){
+            return a->bestTotal < b->bestTotal;
+        });
+        _bestScore = (*best)->bestTotal;
+        _lastBest = (*best)->bestIndex();
+        return _lastBest;
+    }
+
+
+    /// ditto
+    template <typename Rep, typename Period>
+    std::vector<std::vector<ImageID>> refine(std::vector<std::vector<ImageID>> const & idx, std::chrono::duration<Rep, Period> timeLimit,
+                                             std::function<bool()> stopped = nullptr)
+    {
+        return refine(idx, Clock::now() + std::chrono::duration_cast<Clock::duration>(timeLimit), std::move(stopped));
+    }
+
+
+  private:
+    struct Replica
+    {
+        Replica(DividedImage const & master, std::vector<std::vector<ImageID>> const & idx, CostTable const & costs, uint64_t seed)
+        : img(master, idx), scorer(img, costs), rng(seed), temperature(1),
+          best(scorer.fragments()), bestTotal(scorer.total())
+        {}
+
+        SwappedImage img;
+        ArrangementScorer scorer;
+        std::mt19937_64 rng;
+        double temperature;
+
+        std::vector<uint16_t> best;     // 最良の配置 (`ArrangementScorer::fragments`の形式)
+        double bestTotal;
+        std::vector<std::pair<Position, Position>> applied;     // 試行中の近傍で行った交換
+
+        std::vector<std::vector<ImageID>> bestIndex() const
+        {
+            const std::size_t W = scorer.div_x(), H = scorer.div_y();
+            std::vector<std::vector<ImageID>> dst(H);
+            for(auto i: iota(H))
+                for(auto j: iota(W)){
+                    const auto f = best[i * W + j];
+                    dst[i].emplace_back(f / W, f % W);
+                }
+
+            return dst;
+        }
+    };
+
+
+    /** レプリカとコーディネータの同期。
+    レプリカは`epoch`が進むたびに`exchangeInterval`回試行して`arrived`を増やし、次に進むまで待ちます。
+    `refine`の呼び出しの間も、レプリカのスレッドはここで待っています。
+    */
+    struct Sync
+    {
+        std::mutex mutex;
+        std::condition_variable coordinator;
+        std::condition_variable workers;
+        std::size_t arrived = 0;
+        std::size_t epoch = 0;
+        bool finish = false;
+        std::exception_ptr ex;
+    };
+
+
+    DividedImage _img;
+    CostTable _costs;
+    std::size_t _replicas;
+    double _tMin;
+    double _tMax;
+    std::size_t _exchangeInterval;
+    uint64_t _seed;
+
+    double _bestScore;
+    std::size_t _exchanges;
+    std::size_t _acceptedExchanges;
+
+    // `refine`の呼び出しをまたいで引き継ぐ状態
+    std::size_t _calls;
+    std::size_t _epochs;
+    std::vector<std::unique_ptr<Replica>> _rs;
+    std::vector<std::vector<ImageID>> _lastBest;
+    std::mt19937_64 _exchangeRng;
+    std::unique_ptr<Sync> _sync;
+    std::vector<std::thread> _threads;
+    Clock::time_point _deadline;            // 以下2つは、レプリカが待っている間にのみ書き換える
+    std::function<bool()> _stopped;
+
+
+    bool finished() const { return Clock::now() >= _deadline || (_stopped && _stopped()); }
+
+
+    /** `idx`からレプリカを作りなおし、スレッドを起動します。スレッドは最初の`epoch`まで待ちます。
+    各レプリカはそのスレッドで作るので、表を複製している場合はスレッドのNUMAノードの複製を使います。
+    */
+    void restart(std::vector<std::vector<ImageID>> const & idx)
+    {
+        shutdown();
+
+        // 同じ種で同じ探索を繰り返さないよう、呼び出し回数を混ぜる
+        const uint64_t seed = _seed + _calls * 0xBF58476D1CE4E5B9ull;
+        _rs.resize(_replicas);
+        _exchangeRng.seed(seed ^ 0xD1B54A32D192ED03ull);
+        _epochs = 0;
+        _sync.reset(new Sync);
+
+        std::exception_ptr ex;
+        try{
+            for(auto r: iota(_rs.size()))
+                _threads.emplace_back([this, r, &idx, s = seed + r * 0x9E3779B97F4A7C15ull](){ work(r, idx, s); });
+
+            // 全てのレプリカができるまで待つ (それまで`idx`は生きている必要がある)
+            std::unique_lock<std::mutex> lock(_sync->mutex);
+            _sync->coordinator.wait(lock, [&]{ return _sync->arrived == _rs.size(); });
+            ex = _sync->ex;
+        }
+        catch(...){
+            ex = std::current_exception();
+        }
+
+        if(ex){
+            shutdown();
+            std::rethrow_exception(ex);
+        }
+
+        // 温度は低い順
+        std::vector<double> temps = temperatures(*_rs[0], _rs.size());
+        for(auto r: iota(_rs.size()))
+            _rs[r]->temperature = temps[r];
+    }
+
+
+    /// レプリカのスレッドを終了し、レプリカを破棄します
+    void shutdown()
+    {
+        if(_sync){
+            {
+                std::lock_guard<std::mutex> lock(_sync->mutex);
+                _sync->finish = true;
+                ++_sync->epoch;
+            }
+            _sync->workers.notify_all();
+            for(auto& th: _threads)
+                th.join();
+        }
+
+        _threads.clear();
+        _rs.clear();
+        _lastBest.clear();
+        _sync.reset();
+    }
+
+
+    /// レプリカのスレッドの本体。`r`番目のレプリカを作ってから、`epoch`が進むたびに探索を進めます。
+    void work(std::size_t r, std::vector<std::vector<ImageID>> const & idx, uint64_t seed)
+    {
+        Sync& sync = *_sync;
+        const std::size_t nReplicas = _rs.size();
+        try{
+            _rs[r].reset(new Replica(_img, idx, _costs, seed));
+        }
+        catch(...){
+            std::lock_guard<std::mutex> lock(sync.mutex);
+            if(!sync.ex) sync.ex = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sync.mutex);
+            if(++sync.arrived == nReplicas)
+                sync.coordinator.notify_one();
+        }
+
+        std::size_t epoch = 0;
+        while(1){
+            {
+                std::unique_lock<std::mutex> lock(sync.mutex);
+                sync.workers.wait(lock, [&]{ return sync.epoch != epoch; });
+                epoch = sync.epoch;
+                if(sync.finish)
+                    return;
+            }
+
+            try{
+                for(std::size_t i = 0; i < _exchangeInterval; ++i){
+                    if((i & 1023) == 1023 && finished())
+                        break;
+
+                    step(*_rs[r]);
+                }
+            }
+            catch(...){
+                std::lock_guard<std::mutex> lock(sync.mutex);
+                if(!sync.ex) sync.ex = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(sync.mutex);
+            if(++sync.arrived == nReplicas)
+                sync.coordinator.notify_one();
+        }
+    }
+
+
+    std::vector<double> temperatures(Replica& rep, std::size_t n) const
+    {
+        double tMin = _tMin, tMax = _tMax;
+        if(tMax == 0){
+            const auto& sc = rep.scorer;
+            double sum = 0;
+            for(std::size_t i = 0; i < 1000; ++i)
+                sum += std::fabs(sc.swapDelta(randomCell(rep), randomCell(rep)));
+
+            tMax = std::max(sum / 1000, 1e-6);
+            tMin = tMax * 1e-3;
+        }
+
+        std::vector<double> dst(n, tMin);
+        for(std::size_t r = 1; r < n; ++r)
+            dst[r] = tMin * std::pow(tMax / tMin, static_cast<double>(r) / (n - 1));
+
+        return dst;
+    }
+
+
+    Position randomCell(Replica& rep) const
+    {
+        const auto& sc = rep.scorer;
+        return Position(rep.rng() % sc.div_y(), rep.rng() % sc.div_x());
+    }
+
+
+    static double uniform(std::mt19937_64& rng)
+    {
+        return (rng() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+
+    void apply(Replica& rep, Position a, Position b, double& delta) const
+    {
+        delta += rep.scorer.swap_element(a, b);
+        rep.applied.emplace_back(a, b);
+    }
+
+
+    /// 近傍を1つ試し、メトロポリス法で採否を決めます
+    void step(Replica& rep) const
+    {
+        auto& sc = rep.scorer;
+        const std::size_t W = sc.div_x(), H = sc.div_y();
+        auto& rng = rep.rng;
+
+        rep.applied.clear();
+        double delta = 0;
+        const auto kind = rng() % 8;
+        if(kind < 5){
+            // 2断片の交換は、適用せずに変化量を求められる
+            const Position a = randomCell(rep),
+                           b = kind < 3 ? randomCell(rep) : a.moved(static_cast<Direction>(rng() % 4));
+            if(!b.inside(W, H) || a == b)
+                return;
+
+            const double d = sc.swapDelta(a, b);
+            if(accept(rep, d))
+                sc.swap_element(a, b);
+        }else{
+            if(kind == 5){
+                // 重ならない2つのブロックの交換
+                const std::size_t h = 1 + rng() % std::min<std::size_t>(3, H),
+                                  w = 1 + rng() % std::min<std::size_t>(3, W);
+                const std::size_t r1 = rng() % (H - h + 1), c1 = rng() % (W - w + 1),
+                                  r2 = rng() % (H - h + 1), c2 = rng() % (W - w + 1);
+                if((r1 < r2 + h && r2 < r1 + h && c1 < c2 + w && c2 < c1 + w) || h * w == 1)
+                    return;
+
+                for(auto i: iota(h))
+                    for(auto j: iota(w))
+                        apply(rep, Position(r1 + i, c1 + j), Position(r2 + i, c2 + j), delta);
+            }else{
+                // 行または列の一部の巡回シフト
+                const bool row = kind == 6;
+                const std::size_t len = row ? W : H;
+                if(len < 2)
+                    return;
+
+                const std::size_t L = 2 + rng() % (std::min<std::size_t>(8, len) - 1),
+                                  s = rng() % (len - L + 1),
+                                  line = rng() % (row ? H : W);
+                const bool forward = rng() & 1;
+                auto cell = [&](std::size_t k){ return row ? Position(line, s + k) : Position(s + k, line); };
+
+                for(std::size_t k = 0; k + 1 < L; ++k){
+                    const std::size_t p = forward ? k : L - 1 - k,
+                                      q = forward ? k + 1 : L - 2 - k;
+                    apply(rep, cell(p), cell(q), delta);
+                }
+            }
+
+            if(!accept(rep, delta))
+                for(auto it = rep.applied.rbegin(); it != rep.applied.rend(); ++it)
+                    sc.swap_element(it->first, it->second);
+        }
+
+        if(sc.total() < rep.bestTotal - 1e-9){
+            rep.bestTotal = sc.total();
+            rep.best = sc.fragments();      // 同じ大きさなので確保は起きない
+        }
+    }
+
+
+    static bool accept(Replica& rep, double delta)
+    {
+        return delta <= 0 || uniform(rep.rng) < std::exp(-delta / rep.temperature);
+    }
+
+
+    /// 温度の低い順に並べて、隣り合う組(偶数番目から始めるか奇数番目から始めるか交互)の温度の交換を試みます
+    void exchange(std::vector<std::unique_ptr<Replica>>& rs, bool odd, std::mt19937_64& rng)
+    {
+        std::vector<Replica*> order;
+        for(auto& r: rs)
+            order.push_back(r.get());
+
+        std::sort(order.begin(), order.end(), [](Replica* a, Replica* b){ return a->temperature < b->temperature; });
+
+        for(std::size_t i = odd ? 1 : 0; i + 1 < order.size(); i += 2){
+            Replica& a = *order[i];
+            Replica& b = *order[i + 1];
+            const double d = (1 / a.temperature - 1 / b.temperature) * (a.scorer.total() - b.scorer.total());
+
+            ++_exchanges;
+            if(d >= 0 || uniform(rng) < std::exp(d)){
+                std::swap(a.temperature, b.temperature);
+                ++_acceptedExchanges;
+            }
+        }
+    }
+};
+
+
+/** `TemperingRefiner`を`AnytimeSolver`の戦略にします。
+最良の配置(まだ無ければ恒等配置)を`slice`ずつ改善し、改善するたびに接合部のコストの総和を評価値として`publishTarget`します。
+*/
+inline AnytimeSolver::Strategy makeTemperingStrategy(CostTable const & costs, std::chrono::milliseconds slice = std::chrono::milliseconds(200))
+{
+    return [costs, slice](AnytimeContext& ctx){
+        auto const & pb = ctx.problem();
+        TemperingRefiner refiner(pb.dividedImage(), costs);
+
+        auto t = ctx.target();
+        auto idx = t.first ? t.first->get_index() : Arrangement(pb.div_x(), pb.div_y()).get_index();
+
+        while(!ctx.stopped()){
+            const auto until = std::min(ctx.deadline(), AnytimeContext::Clock::now() + slice);
+            idx = refiner.refine(idx, until, [&]{ return ctx.stopped(); });
+            ctx.publishTarget(Arrangement(idx), refiner.bestScore());
+        }
+    };
+}
+
+}} // namespace procon::utils
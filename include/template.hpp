@@ -44,9 +44,9 @@
 
 
 #ifdef NOT_SUPPORT_CONSTEXPR
-#define PROCON_TEMPLATE_CONSTRAINTS(b) typename void*& = procon::utils::enabler_ptr
+#define PROCON_TEMPLATE_CONSTRAINTS(b) typename void*& = procon::utils::Enabler<>::ptr
 #else
-#define PROCON_TEMPLATE_CONSTRAINTS(b) typename std::enable_if<(b)>::type *& = procon::utils::enabler_ptr
+#define PROCON_TEMPLATE_CONSTRAINTS(b) typename std::enable_if<(b)>::type *& = procon::utils::Enabler<>::ptr
 #endif
 
 #ifdef NOT_SUPPORT_CONSTEXPR
@@ -75,8 +75,16 @@ namespace procon{ namespace utils{
 
 /**
 擬似Concept Liteを構築する際に、enable_ifテクニックで使用する
+クラステンプレートの静的メンバにしてあるので、複数の翻訳単位から読み込んでも多重定義になりません。
 */
-void* enabler_ptr;
+template <typename T = void>
+struct Enabler
+{
+    static void* ptr;
+};
+
+template <typename T>
+void* Enabler<T>::ptr = nullptr;
 
 template <bool b, typename T>
 using Requires = std::enable_if_t<b, T>;
@@ -0,0 +1,838 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <boost/optional.hpp>
+#include "constants.hpp"
+#include "range.hpp"
+#include "exception.hpp"
+
+#if defined(TARGET_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+namespace procon { namespace utils {
+
+class ThreadPool;
+
+
+namespace thread_pool_detail {
+
+/// `Future`が共有する状態
+template <typename T>
+struct FutureState
+{
+    explicit FutureState(ThreadPool* p) : pool(p) {}
+
+    ThreadPool* pool;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool ready = false;
+    boost::optional<T> value;
+    std::exception_ptr ex;
+    std::vector<std::function<void()>> continuations;
+};
+
+
+/// `void`を返す関数の結果の代わりに保持する型
+struct Unit {};
+
+
+template <typename T>
+struct Stored { typedef T type; };
+
+template <>
+struct Stored<void> { typedef Unit type; };
+
+
+/// `f(args...)`の結果を`dst`に入れます
+template <typename F, typename... Args>
+auto invokeInto(boost::optional<Unit>& dst, F& f, Args&&... args)
+-> std::enable_if_t<std::is_void<decltype(f(std::forward<Args>(args)...))>::value>
+{
+    f(std::forward<Args>(args)...);
+    dst = Unit();
+}
+
+
+template <typename T, typename F, typename... Args>
+auto invokeInto(boost::optional<T>& dst, F& f, Args&&... args)
+-> std::enable_if_t<!std::is_void<decltype(f(std::forward<Args>(args)...))>::value>
+{
+    dst = f(std::forward<Args>(args)...);
+}
+
+
+/// 結果が`T`の`Future`に登録した継続`f`の結果の型
+template <typename T, typename F>
+struct ContinuationResult { typedef decltype(std::declval<F&>()(std::declval<T const &>())) type; };
+
+template <typename F>
+struct ContinuationResult<void, F> { typedef decltype(std::declval<F&>()()) type; };
+
+
+/// 元のタスクの結果`src`を渡して継続`f`を呼びます
+template <typename V, typename F, typename S>
+void invokeContinuation(boost::optional<V>& dst, F& f, FutureState<S>& src)
+{
+    invokeInto(dst, f, static_cast<S const &>(*src.value));
+}
+
+
+template <typename V, typename F>
+void invokeContinuation(boost::optional<V>& dst, F& f, FutureState<Unit>&)
+{
+    invokeInto(dst, f);
+}
+
+} // namespace thread_pool_detail
+
+
+/** `ThreadPool`に投入したタスクの結果です。
+コピーしたものは同じ結果を共有し、`get()`は何度でも呼べます(結果はコピーして返します)。
+タスクが例外を投げた場合は、`get()`がその例外を投げなおします。
+
+`then(f)`で、結果が出たときにプール上で`f(結果)`(`void`なら`f()`)を呼ぶ継続を登録し、その結果の`Future`を得られます。
+元のタスクが例外を投げた場合、`f`は呼ばれず、継続の結果も同じ例外になります。
+
+プールのワーカースレッドから`wait()`や`get()`を呼んだ場合は、待つ間に他のタスクを実行するので、
+タスクの中から別のタスクの結果を待ってもデッドロックしません。
+*/
+template <typename T>
+class Future
+{
+  public:
+    typedef T value_type;
+
+    Future() = default;
+    explicit Future(std::shared_ptr<thread_pool_detail::FutureState<typename thread_pool_detail::Stored<T>::type>> st)
+    : _state(std::move(st)) {}
+
+
+    bool valid() const { return static_cast<bool>(_state); }
+
+
+    bool ready() const
+    {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        return _state->ready;
+    }
+
+
+    void wait() const;
+
+
+    T get() const
+    {
+        wait();
+        if(_state->ex)
+            std::rethrow_exception(_state->ex);
+
+        return value(std::is_void<T>());
+    }
+
+
+    template <typename F>
+    Future<typename thread_pool_detail::ContinuationResult<T, F>::type> then(F f) const;
+
+
+  private:
+    std::shared_ptr<thread_pool_detail::FutureState<typename thread_pool_detail::Stored<T>::type>> _state;
+
+    template <typename U>
+    friend class Future;
+
+
+    T value(std::false_type) const { return *_state->value; }
+    void value(std::true_type) const {}
+};
+
+
+/** ワークスティーリングを行うスレッドプールです。
+
+各ワーカーは自分の両端キューを持ち、自分が投入したタスクは末尾から(LIFO)取り出し、
+自分のキューが空なら他のワーカーのキューの先頭から(FIFO)盗みます。
+ワーカー以外のスレッドから投入したタスクは、各ワーカーのキューに順番に配ります。
+実行するタスクが無いワーカーは条件変数で眠るので、CPUを消費しません。
+
++ `submit(f)`         `f()`を実行し、その結果の`Future`を返します
++ `parallel_for`      `iota`や`grid_range`の各要素について並列に関数を呼びます。呼び出し元のスレッドも処理に加わります
++ `TaskGraph::run`    依存関係のあるタスクの集まりを実行します
+
+`pinToCores`を指定すると、ワーカーkをコア(k + 1) mod コア数に固定します(コア0は呼び出し元のスレッドのために空けておきます)。
+固定はLinuxでのみ行い、他の環境では無視します。
+
+デストラクタは、キューに残っているタスクを全て実行してからワーカーを終了します。
+
+Example:
+------------
+ThreadPool pool(4);
+
+auto f = pool.submit([&]{ return loadProblem(path); })
+             .then([](Problem const & pb){ return CostTable(pb.view()); });
+
+pool.parallel_for(iota(n), [&](std::size_t i){ ys[i] = g(xs[i]); });
+pool.parallel_for(grid_range(pb.div_y(), pb.div_x()), [&](std::size_t i, std::size_t j){ ... });
+------------
+*/
+class ThreadPool
+{
+  public:
+    typedef std::function<void()> Task;
+
+
+    explicit ThreadPool(std::size_t nThreads = std::thread::hardware_concurrency(), bool pinToCores = false)
+    : _queued(0), _nextQueue(0), _waiters(0), _stop(false)
+    {
+        nThreads = std::max<std::size_t>(nThreads, 1);
+        for(std::size_t k = 0; k < nThreads; ++k)
+            _workers.emplace_back(std::make_unique<Worker>());
+
+        try{
+            for(std::size_t k = 0; k < nThreads; ++k)
+                _workers[k]->thread = std::thread([this, k, pinToCores](){
+                    if(pinToCores)
+                        pinCurrentThread(k + 1);
+
+                    current().pool = this;
+                    current().index = k;
+                    workerLoop(k);
+                });
+        }
+        catch(...){
+            // 途中までに起動したワーカーを止めてから投げなおす
+            stopAndJoin();
+            throw;
+        }
+    }
+
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool& operator=(ThreadPool const &) = delete;
+
+
+    ~ThreadPool() { stopAndJoin(); }
+
+
+    /// ワーカースレッドの数
+    std::size_t size() const { return _workers.size(); }
+
+
+    /// 呼び出したスレッドが、このプールのワーカーかどうか
+    bool isWorker() const { return current().pool == this; }
+
+
+    /** 呼び出したスレッドのワーカー番号を返します。ワーカー以外のスレッドでは`size()`を返します。
+    `parallel_for`の中でワーカーごとの作業領域を使う場合は、`size() + 1`個用意してこの番号で引いてください。
+    */
+    std::size_t workerIndex() const { return isWorker() ? current().index : size(); }
+
+
+    /** タスクをキューに入れます。`task`は例外を投げてはいけません。
+    結果や例外が必要な場合は`submit`を使ってください。
+    */
+    void post(Task task)
+    {
+        const std::size_t q = isWorker() ? current().index : _nextQueue.fetch_add(1, std::memory_order_relaxed) % size();
+        {
+            std::lock_guard<std::mutex> lock(_workers[q]->mutex);
+            _workers[q]->tasks.push_back(std::move(task));
+        }
+        _queued.fetch_add(1);
+
+        // 眠ろうとしているワーカーが通知を取りこぼさないよう、ロックを経由してから起こす
+        bool waiting;
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+            waiting = _waiters != 0;
+        }
+        _sleepCv.notify_one();
+
+        // `waitUntil`で待っているワーカーにも手伝わせる
+        if(waiting)
+            _waitCv.notify_all();
+    }
+
+
+    /// `f()`を実行し、その結果の`Future`を返します
+    template <typename F>
+    auto submit(F f) -> Future<decltype(f())>
+    {
+        typedef decltype(f()) R;
+        auto st = std::make_shared<thread_pool_detail::FutureState<typename thread_pool_detail::Stored<R>::type>>(this);
+        auto fn = std::make_shared<F>(std::move(f));
+
+        post([st, fn](){
+            boost::optional<typename thread_pool_detail::Stored<R>::type> v;
+            std::exception_ptr ex;
+            try{
+                thread_pool_detail::invokeInto(v, *fn);
+            }
+            catch(...){
+                ex = std::current_exception();
+            }
+
+            complete(*st, std::move(v), ex);
+        });
+
+        return Future<R>(st);
+    }
+
+
+    /** キューからタスクを1つ取り出して実行します。実行するタスクが無ければfalseを返します。
+    ワーカー以外のスレッドからも呼べます。
+    */
+    bool runOne()
+    {
+        Task task;
+        if(!tryPop(isWorker() ? current().index : 0, task))
+            return false;
+
+        task();
+        return true;
+    }
+
+
+    /** `ready()`が真になるまで待ちます。`ready()`は`mutex`をロックした状態で呼ばれ、
+    真にしたスレッドは、`mutex`を離してから`cv`に通知し、`wakeWaiters()`を呼ぶ必要があります。
+    ワーカースレッドから呼んだ場合は、待つ間にキューのタスクを実行し、
+    実行するタスクが無ければ、タスクが投入されるか`wakeWaiters()`が呼ばれるまで眠ります。
+    */
+    template <typename P>
+    void waitUntil(std::mutex& mutex, std::condition_variable& cv, P ready)
+    {
+        if(!isWorker()){
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, ready);
+            return;
+        }
+
+        while(true){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(ready())
+                    return;
+            }
+
+            if(runOne())
+                continue;
+
+            std::unique_lock<std::mutex> sleep(_sleepMutex);
+            ++_waiters;
+            _waitCv.wait(sleep, [&]{
+                if(_queued.load() != 0)
+                    return true;
+
+                std::lock_guard<std::mutex> lock(mutex);
+                return ready();
+            });
+            --_waiters;
+        }
+    }
+
+
+    /// `waitUntil`で眠っているワーカーを起こし、待っている条件を見なおさせます
+    void wakeWaiters()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+            if(_waiters == 0)
+                return;
+        }
+        _waitCv.notify_all();
+    }
+
+
+    /** `r`の各要素vについて`f(v)`を並列に呼びます。`r`は`iota`が返す範囲のように、`size()`と`operator[]`を持つ必要があります。
+    `maxThreads`が0でなければ、呼び出し元を含めて高々`maxThreads`スレッドで処理します。
+    要素は連続したいくつかずつにまとめて、空いたスレッドが順に取っていきます。
+    `f`が例外を投げた場合は残りの要素の処理を打ち切り、処理中の要素が全て終わってから最初の例外を投げなおします。
+    */
+    template <typename R, typename F>
+    auto parallel_for(R const & r, F f, std::size_t maxThreads = 0)
+    -> decltype(f(r[0]), r.size(), void())
+    {
+        forEachIndex(r.size(), [&](std::size_t k){ f(r[k]); }, maxThreads);
+    }
+
+
+    /// `grid_range`の各位置(i, j)について`f(i, j)`を並列に呼びます
+    template <typename F>
+    void parallel_for(GridRange const & r, F f, std::size_t maxThreads = 0)
+    {
+        const std::size_t cols = r.cols();
+        forEachIndex(r.size(), [&](std::size_t k){ f(k / cols, k % cols); }, maxThreads);
+    }
+
+
+  private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    /// 呼び出したスレッドがワーカーなら、そのプールと番号
+    struct Current
+    {
+        ThreadPool* pool = nullptr;
+        std::size_t index = 0;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<std::size_t> _queued;       // 全てのキューに入っているタスクの数
+    std::atomic<std::size_t> _nextQueue;
+    std::mutex _sleepMutex;
+    std::condition_variable _sleepCv;
+    std::condition_variable _waitCv;        // `waitUntil`で待っているワーカーを起こす
+    std::size_t _waiters;                   // `waitUntil`で眠っているワーカーの数 (_sleepMutexで保護)
+    bool _stop;
+
+    template <typename T>
+    friend class Future;
+
+
+    static Current& current()
+    {
+        static thread_local Current cur;
+        return cur;
+    }
+
+
+    static void pinCurrentThread(std::size_t core)
+    {
+#if defined(TARGET_LINUX)
+        const std::size_t cores = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(static_cast<int>(core % cores % CPU_SETSIZE), &set);
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#else
+        (void)core;
+#endif
+    }
+
+
+    /// ワーカーを止め、起動している全てのワーカーの終了を待ちます
+    void stopAndJoin()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+            _stop = true;
+        }
+        _sleepCv.notify_all();
+
+        for(auto& w: _workers)
+            if(w->thread.joinable())
+                w->thread.join();
+    }
+
+
+    /// 自分のキューの末尾、なければ他のワーカーのキューの先頭からタスクを取り出します
+    bool tryPop(std::size_t self, Task& dst)
+    {
+        if(_queued.load() == 0)
+            return false;
+
+        for(std::size_t i = 0; i < size(); ++i){
+            Worker& w = *_workers[(self + i) % size()];
+            std::lock_guard<std::mutex> lock(w.mutex);
+            if(w.tasks.empty())
+                continue;
+
+            if(i == 0){
+                dst = std::move(w.tasks.back());
+                w.tasks.pop_back();
+            }else{
+                dst = std::move(w.tasks.front());
+                w.tasks.pop_front();
+            }
+
+            _queued.fetch_sub(1);
+            return true;
+        }
+
+        return false;
+    }
+
+
+    void workerLoop(std::size_t self)
+    {
+        while(true){
+            Task task;
+            if(tryPop(self, task)){
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(_sleepMutex);
+            _sleepCv.wait(lock, [&]{ return _stop || _queued.load() != 0; });
+            if(_stop && _queued.load() == 0)
+                return;
+        }
+    }
+
+
+    /// `f(0)`から`f(n-1)`を並列に呼びます
+    template <typename F>
+    void forEachIndex(std::size_t n, F const & f, std::size_t maxThreads)
+    {
+        if(n == 0)
+            return;
+
+        const std::size_t threads = std::min(maxThreads ? maxThreads : size() + 1, size() + 1),
+                          grain = std::max<std::size_t>(1, n / (threads * 16)),
+                          chunks = (n + grain - 1) / grain,
+                          helpers = std::min(threads, chunks) - 1;
+
+        if(helpers == 0){
+            for(std::size_t k = 0; k < n; ++k)
+                f(k);
+            return;
+        }
+
+        // 遅れて始まったヘルパーは、塊が残っていなければ`run`に触れずに終わるので、
+        // 全ての塊が終わった時点で呼び出し元は戻ってよい
+        struct Shared
+        {
+            std::atomic<std::size_t> next{0};
+            std::atomic<std::size_t> done{0};
+            std::atomic<bool> failed{false};
+            std::size_t chunks;
+            std::function<void(std::size_t)> const * run;
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::exception_ptr ex;
+        };
+
+        const std::function<void(std::size_t)> run = [&](std::size_t c){
+            const std::size_t last = std::min(n, (c + 1) * grain);
+            for(std::size_t k = c * grain; k < last; ++k)
+                f(k);
+        };
+
+        auto sh = std::make_shared<Shared>();
+        sh->chunks = chunks;
+        sh->run = &run;
+
+        auto work = [](Shared& s){
+            for(std::size_t c; (c = s.next.fetch_add(1)) < s.chunks;){
+                if(!s.failed.load()){
+                    try{
+                        (*s.run)(c);
+                    }
+                    catch(...){
+                        std::lock_guard<std::mutex> lock(s.mutex);
+                        if(!s.ex) s.ex = std::current_exception();
+                        s.failed = true;
+                    }
+                }
+
+                if(s.done.fetch_add(1) + 1 == s.chunks){
+                    std::lock_guard<std::mutex> lock(s.mutex);
+                    s.cv.notify_all();
+                }
+            }
+        };
+
+        for(std::size_t t = 0; t < helpers; ++t)
+            post([sh, work](){ work(*sh); });
+
+        work(*sh);
+
+        // 残りの塊は既に他のスレッドが処理中なので、ワーカーでも他のタスクを手伝わずに待つ
+        {
+            std::unique_lock<std::mutex> lock(sh->mutex);
+            sh->cv.wait(lock, [&]{ return sh->done.load() == sh->chunks; });
+        }
+
+        if(sh->ex)
+            std::rethrow_exception(sh->ex);
+    }
+
+
+    /// 結果を設定し、待っているスレッドを起こして、継続をキューに入れます
+    template <typename V>
+    static void complete(thread_pool_detail::FutureState<V>& st, boost::optional<V> v, std::exception_ptr ex)
+    {
+        std::vector<std::function<void()>> conts;
+        {
+            std::lock_guard<std::mutex> lock(st.mutex);
+            st.value = std::move(v);
+            st.ex = ex;
+            st.ready = true;
+            conts.swap(st.continuations);
+        }
+        st.cv.notify_all();
+        st.pool->wakeWaiters();
+
+        for(auto& c: conts)
+            c();
+    }
+};
+
+
+template <typename T>
+void Future<T>::wait() const
+{
+    PROCON_ENFORCE(valid(), "the future has no state");
+
+    auto& st = *_state;
+    st.pool->waitUntil(st.mutex, st.cv, [&]{ return st.ready; });
+}
+
+
+template <typename T>
+template <typename F>
+Future<typename thread_pool_detail::ContinuationResult<T, F>::type> Future<T>::then(F f) const
+{
+    PROCON_ENFORCE(valid(), "the future has no state");
+
+    typedef typename thread_pool_detail::ContinuationResult<T, F>::type R;
+    typedef typename thread_pool_detail::Stored<R>::type V;
+
+    ThreadPool* pool = _state->pool;
+    auto src = _state;
+    auto dst = std::make_shared<thread_pool_detail::FutureState<V>>(pool);
+    auto fn = std::make_shared<F>(std::move(f));
+
+    // 元の結果が出たときに、継続をプールに投入する
+    std::function<void()> cont = [pool, src, dst, fn](){
+        pool->post([src, dst, fn](){
+            boost::optional<V> v;
+            std::exception_ptr ex = src->ex;
+            if(!ex){
+                try{
+                    thread_pool_detail::invokeContinuation(v, *fn, *src);
+                }
+                catch(...){
+                    ex = std::current_exception();
+                }
+            }
+
+            ThreadPool::complete(*dst, std::move(v), ex);
+        });
+    };
+
+    {
+        std::unique_lock<std::mutex> lock(_state->mutex);
+        if(!_state->ready){
+            _state->continuations.push_back(std::move(cont));
+            cont = nullptr;
+        }
+    }
+
+    if(cont)
+        cont();
+
+    return Future<R>(dst);
+}
+
+
+/** 依存関係のあるタスクの集まり(有向非巡回グラフ)です。
+`add(f, deps)`で、`deps`の全てのタスクが終わってから実行するタスクを追加します。
+依存先は既に追加したタスクに限られるので、グラフに閉路はできません。
+
+`run`は、依存先が全て終わったタスクから順にプールに投入し、全てのタスクが終わるまで待ちます。
+タスクが例外を投げた場合、そのタスクに(間接的に)依存するタスクは実行せず、他のタスクが全て終わってから最初の例外を投げなおします。
+タスクの間のデータの受け渡しは、タスクが参照する変数を通して行ってください。
+
+Example:
+------------
+Problem pb; CostTable costs; Answer ans;
+
+TaskGraph g;
+auto load = g.add([&]{ pb = loadProblem(path); });
+auto prep = g.add([&]{ costs = CostTable(pb.view()); }, {load});
+auto solve = g.add([&]{ idx = StripAssembler(pb.view(), costs).assemble(); }, {prep});
+auto plan = g.add([&]{ ans = planAnswer(pb, idx); }, {solve});
+g.run();
+------------
+*/
+class TaskGraph
+{
+  public:
+    typedef std::size_t Node;
+
+
+    /// タスクを追加し、その番号を返します
+    Node add(std::function<void()> f, std::vector<Node> const & deps = {})
+    {
+        const Node id = _tasks.size();
+        for(auto d: deps){
+            PROCON_ENFORCE(d < id, "the dependency is not in the graph");
+            _successors[d].push_back(id);
+        }
+
+        _tasks.push_back(std::move(f));
+        _successors.emplace_back();
+        _numDeps.push_back(deps.size());
+        return id;
+    }
+
+
+    std::size_t size() const { return _tasks.size(); }
+
+
+    /// 全てのタスクを実行します
+    void run(ThreadPool& pool) const
+    {
+        if(_tasks.empty())
+            return;
+
+        struct Shared
+        {
+            TaskGraph const * graph;
+            ThreadPool* pool;
+            std::unique_ptr<std::atomic<std::size_t>[]> waiting;    // まだ終わっていない依存先の数
+            std::unique_ptr<std::atomic<bool>[]> skipped;           // 依存先が失敗したので実行しない
+            std::size_t remaining;
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::exception_ptr ex;
+        };
+
+        auto sh = std::make_shared<Shared>();
+        sh->graph = this;
+        sh->pool = &pool;
+        sh->waiting.reset(new std::atomic<std::size_t>[size()]);
+        sh->skipped.reset(new std::atomic<bool>[size()]);
+        sh->remaining = size();
+        for(std::size_t k = 0; k < size(); ++k){
+            sh->waiting[k] = _numDeps[k];
+            sh->skipped[k] = false;
+        }
+
+        for(std::size_t k = 0; k < size(); ++k)
+            if(_numDeps[k] == 0)
+                schedule(sh, k);
+
+        pool.waitUntil(sh->mutex, sh->cv, [&]{ return sh->remaining == 0; });
+
+        if(sh->ex)
+            std::rethrow_exception(sh->ex);
+    }
+
+
+    /// 既定のスレッドプールで全てのタスクを実行します
+    void run() const;
+
+
+  private:
+    std::vector<std::function<void()>> _tasks;
+    std::vector<std::vector<Node>> _successors;
+    std::vector<std::size_t> _numDeps;
+
+
+    template <typename S>
+    static void schedule(std::shared_ptr<S> const & sh, Node k)
+    {
+        sh->pool->post([sh, k](){
+            TaskGraph const & g = *sh->graph;
+            bool failed = sh->skipped[k].load();
+            if(!failed){
+                try{
+                    g._tasks[k]();
+                }
+                catch(...){
+                    std::lock_guard<std::mutex> lock(sh->mutex);
+                    if(!sh->ex) sh->ex = std::current_exception();
+                    failed = true;
+                }
+            }
+
+            // 失敗したタスクの後続も、スキップしたことを伝えるために投入する
+            for(auto s: g._successors[k]){
+                if(failed)
+                    sh->skipped[s] = true;
+
+                if(sh->waiting[s].fetch_sub(1) == 1)
+                    schedule(sh, s);
+            }
+
+            bool last;
+            {
+                std::lock_guard<std::mutex> lock(sh->mutex);
+                last = --sh->remaining == 0;
+            }
+
+            if(last){
+                sh->cv.notify_all();
+                sh->pool->wakeWaiters();
+            }
+        });
+    }
+};
+
+
+namespace thread_pool_detail {
+
+struct DefaultPoolConfig
+{
+    std::mutex mutex;
+    std::size_t threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 2) - 1;
+    bool pinToCores = false;
+    bool created = false;
+};
+
+
+inline DefaultPoolConfig& defaultPoolConfig()
+{
+    static DefaultPoolConfig config;
+    return config;
+}
+
+} // namespace thread_pool_detail
+
+
+/** 既定のスレッドプールの設定を変えます。`defaultThreadPool()`を最初に呼ぶより前に呼ぶ必要があります。
+*/
+inline void configureDefaultThreadPool(std::size_t nThreads, bool pinToCores = false)
+{
+    auto& config = thread_pool_detail::defaultPoolConfig();
+    std::lock_guard<std::mutex> lock(config.mutex);
+    PROCON_ENFORCE(!config.created, "the default thread pool is already running");
+
+    config.threads = std::max<std::size_t>(nThreads, 1);
+    config.pinToCores = pinToCores;
+}
+
+
+/** ライブラリ内の並列処理が共有するスレッドプールを返します。
+`parallel_for`では呼び出し元のスレッドも処理に加わるので、既定ではコア数より1つ少ないワーカーを持ちます(最低1つ)。
+*/
+inline ThreadPool& defaultThreadPool()
+{
+    // プログラムの終了時に他の静的オブジェクトのデストラクタからも使えるよう、破棄しない
+    static ThreadPool* pool = [](){
+        auto& config = thread_pool_detail::defaultPoolConfig();
+        std::lock_guard<std::mutex> lock(config.mutex);
+        config.created = true;
+        return new ThreadPool(config.threads, config.pinToCores);
+    }();
+
+    return *pool;
+}
+
+
+inline void TaskGraph::run() const
+{
+    run(defaultThreadPool());
+}
+
+}} // namespace procon::utils
@@ -1,7 +1,14 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "image.hpp"
 #include "template.hpp"
@@ -22,13 +29,82 @@ enum class Direction
 };
 
 
+/// 方向を回答中の文字('R', 'U', 'L', 'D')に変換します
+constexpr char toChar(Direction d)
+{
+    return "RULD"[static_cast<int>(d) & 3];
+}
+
+
+/// 文字が方向を表す文字('R', 'U', 'L', 'D')かどうか判定します
+constexpr bool isDirectionChar(char c)
+{
+    return c == 'R' || c == 'U' || c == 'L' || c == 'D';
+}
+
+
+/// 文字を方向に変換します。`isDirectionChar(c)`が真である必要があります。
+constexpr Direction toDirection(char c)
+{
+    return c == 'R' ? Direction::right
+         : c == 'U' ? Direction::up
+         : c == 'L' ? Direction::left
+         :            Direction::down;
+}
+
+
+/// 逆方向を返します
+constexpr Direction opposite(Direction d)
+{
+    return static_cast<Direction>((static_cast<int>(d) + 2) & 3);
+}
+
+
+/// 方向に進んだときの行の変化量を返します (up: -1, down: +1)
+constexpr int rowOffset(Direction d)
+{
+    return (static_cast<int>(d) & 1) * (static_cast<int>(d) - 2);
+}
+
+
+/// 方向に進んだときの列の変化量を返します (right: +1, left: -1)
+constexpr int colOffset(Direction d)
+{
+    return (~static_cast<int>(d) & 1) * (1 - static_cast<int>(d));
+}
+
+
+/** 断片の向きです。
+下位2bitが反時計回りに90度回転する回数、bit2が左右反転で、反転してから回転します。
+*/
+enum class Orientation : uint8_t
+{
+    upright, rot90, rot180, rot270,
+    flipped, flippedRot90, flippedRot180, flippedRot270,
+};
+
+
+/// 向きの種類の数
+constexpr std::size_t numOrientations = 8;
+
+
+/// 反時計回りに90度回転する回数を返します
+constexpr int rotationOf(Orientation o) { return static_cast<int>(o) & 3; }
+
+/// 左右反転しているかどうかを返します
+constexpr bool isFlipped(Orientation o) { return (static_cast<int>(o) & 4) != 0; }
+
+/// 縦と横が入れ替わるかどうかを返します
+constexpr bool swapsAxes(Orientation o) { return (static_cast<int>(o) & 1) != 0; }
+
+
 /** 2次元インデックス
 */
 typedef std::array<std::size_t, 2> Index2D;
 
 
 /// ditto
-Index2D makeIndex2D(std::size_t i, std::size_t j)
+inline Index2D makeIndex2D(std::size_t i, std::size_t j)
 {
     Index2D idx;
     idx[0] = i;
@@ -37,6 +113,242 @@ Index2D makeIndex2D(std::size_t i, std::size_t j)
 }
 
 
+/** 向き`o`で置いた、高さ`h`、幅`w`の断片の(y, x)の画素が、元の向きの断片のどの画素かを返します。
+*/
+inline Index2D orientedSource(Orientation o, std::size_t y, std::size_t x, std::size_t h, std::size_t w)
+{
+    // 回転を1回ずつ戻す
+    for(int k = 0; k < rotationOf(o); ++k){
+        const std::size_t ny = x, nx = h - 1 - y;
+        y = ny;
+        x = nx;
+        std::swap(h, w);
+    }
+
+    return makeIndex2D(y, isFlipped(o) ? w - 1 - x : x);
+}
+
+
+/**
+8bitの行と列の組で表した、コンパクトな画像位置です。
+`ImageID`と同じく、16bitにパックした値は `(行 << 8) | 列` です。
+分割数は縦横それぞれ`maxDivision`(255)まで扱えます。
+
+盤面の外へ出た場合、行や列は8bitで折り返すので、
+`inside`は符号なし比較のみで(分岐なしで)範囲内か判定できます。
+
+Example:
+------------
+Position pos(0, 3);
+auto next = pos.moved(toDirection('U'));
+if(!next.inside(div_x, div_y))
+    ...     // 盤面の外
+------------
+*/
+struct Position
+{
+    constexpr Position() : _r(0), _c(0) {}
+
+    constexpr Position(std::size_t r, std::size_t c)
+    : _r(static_cast<uint8_t>(r & 0xFF)), _c(static_cast<uint8_t>(c & 0xFF)) {}
+
+    explicit Position(Index2D idx)
+    : Position(idx[0], idx[1]) {}
+
+
+    constexpr std::size_t row() const { return _r; }
+    constexpr std::size_t col() const { return _c; }
+
+    Index2D get_index() const { return makeIndex2D(_r, _c); }
+
+
+    /// `(行 << 8) | 列`を返します
+    constexpr uint16_t packed() const { return static_cast<uint16_t>((_r << 8) | _c); }
+
+    /// ditto
+    static constexpr Position unpack(uint16_t v) { return Position(v >> 8, v & 0xFF); }
+
+
+    /// 行優先で平坦化したインデックスを返します
+    constexpr std::size_t flatten(std::size_t div_x) const { return _r * div_x + _c; }
+
+
+    /// 方向`d`に1つ進んだ位置を返します。盤面の外に出たかどうかは`inside`で判定します。
+    constexpr Position moved(Direction d) const
+    {
+        return Position(static_cast<uint8_t>(_r + rowOffset(d)), static_cast<uint8_t>(_c + colOffset(d)));
+    }
+
+
+    /// 横 div_x, 縦 div_y の盤面の内側にあるかどうか判定します
+    constexpr bool inside(std::size_t div_x, std::size_t div_y) const
+    {
+        return (_r < div_y) & (_c < div_x);
+    }
+
+
+    constexpr bool operator==(Position const & other) const { return packed() == other.packed(); }
+    constexpr bool operator!=(Position const & other) const { return packed() != other.packed(); }
+    constexpr bool operator<(Position const & other) const { return packed() < other.packed(); }
+
+
+    void to_string(std::ostream& s) const
+    {
+        s << "(" << static_cast<std::size_t>(_r) << ", " << static_cast<std::size_t>(_c) << ")";
+    }
+
+
+  private:
+    uint8_t _r;
+    uint8_t _c;
+};
+
+
+/** `Position`や`ImageID`で表せる分割数の上限です。
+盤面の外へ出た位置は8bitで折り返して255になるので、`inside`で区別できるよう256ではなく255としています。
+*/
+constexpr std::size_t maxDivision = 255;
+
+
+/** 選択位置を、回答の形式(列、行の順の16進数)の文字列にします。
+列と行が両方とも16未満なら従来通り1桁ずつ("xy")、そうでなければ2桁ずつ("xxyy")書き出すので、
+16×16を超える分割数でも位置を一意に表せます。
+*/
+inline std::string encodeAnswerPosition(Position p)
+{
+    const char* digits = "0123456789abcdef";
+    std::string dst;
+    if(p.row() < 16 && p.col() < 16){
+        dst += digits[p.col()];
+        dst += digits[p.row()];
+    }else{
+        dst += digits[p.col() >> 4];
+        dst += digits[p.col() & 0xF];
+        dst += digits[p.row() >> 4];
+        dst += digits[p.row() & 0xF];
+    }
+
+    return dst;
+}
+
+
+/** `encodeAnswerPosition`の逆変換です。
+文字列の前半を列、後半を行として16進数で読むので、桁数は2か4です。不正な文字列の場合は例外を投げます。
+*/
+inline Position decodeAnswerPosition(std::string const & str)
+{
+    PROCON_ENFORCE(str.size() == 2 || str.size() == 4, format("invalid position: %", str));
+
+    std::size_t v[2] = {};
+    const std::size_t half = str.size() / 2;
+    for(std::size_t i = 0; i < str.size(); ++i){
+        const char c = str[i];
+        int d = -1;
+        if('0' <= c && c <= '9')      d = c - '0';
+        else if('a' <= c && c <= 'f') d = c - 'a' + 10;
+        else if('A' <= c && c <= 'F') d = c - 'A' + 10;
+        PROCON_ENFORCE(d >= 0, format("invalid position: %", str));
+
+        v[i / half] = v[i / half] * 16 + d;
+    }
+
+    PROCON_ENFORCE(v[0] < maxDivision && v[1] < maxDivision, format("invalid position: %", str));
+    return Position(v[1], v[0]);
+}
+
+
+/**
+横 w, 縦 h の盤面について、各位置から各方向に1つ進んだ位置(行優先で平坦化したもの)のテーブルです。
+盤面の外に出る場合は`cells()`(= w * h)が入っています。
+盤面の大きさごとに一度だけ構築しておけば、探索中の移動はテーブルを1回引くだけになります。
+
+Example:
+------------
+const MoveTable table(16, 16);
+assert(table.move(0, Direction::left) == 16 * 16);
+
+std::size_t cell = 17;
+if(table.canMove(cell, Direction::up))
+    cell = table.move(cell, Direction::up);
+------------
+*/
+struct MoveTable
+{
+    /// `Position`の各成分は8bitなので、w, hはそれぞれ256未満である必要があります
+    MoveTable(std::size_t w, std::size_t h)
+    : _width(w), _height(h), _next(w * h * 4)
+    {
+        const std::size_t n = cells();
+        for(std::size_t i = 0; i < n; ++i)
+            for(int d = 0; d < 4; ++d){
+                const auto p = Position(i / w, i % w).moved(static_cast<Direction>(d));
+                _next[i * 4 + d] = static_cast<uint16_t>(p.inside(w, h) ? p.flatten(w) : n);
+            }
+    }
+
+
+    std::size_t width() const { return _width; }
+    std::size_t height() const { return _height; }
+    std::size_t cells() const { return _width * _height; }
+
+
+    /// 位置`cell`から方向`d`に進んだ位置を返します。盤面の外に出る場合は`cells()`を返します。
+    std::size_t move(std::size_t cell, Direction d) const { return _next[cell * 4 + static_cast<int>(d)]; }
+
+
+    /// 位置`cell`から方向`d`に進めるかどうか判定します
+    bool canMove(std::size_t cell, Direction d) const { return move(cell, d) != cells(); }
+
+
+  private:
+    std::size_t _width;
+    std::size_t _height;
+    std::vector<uint16_t> _next;    // 位置 * 4 + 方向 -> 移動先
+};
+
+
+/** 64bit整数の各ビットをよく混ぜた値を返します(splitmix64の出力関数)。
+Zobristハッシュの鍵の生成や、ハッシュ値の仕上げに使います。
+*/
+constexpr uint64_t mix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+
+/**
+要素同士の大小関係が、そのオブジェクト表現のバイト列の辞書順(`memcmp`)と一致する型であればtrueになります。
+ユーザー定義型は、このテンプレートを特殊化することで`opCmp`の高速な経路を使えるようになります。
+*/
+template <typename E>
+struct is_bytewise_comparable : std::is_same<E, unsigned char> {};
+
+
+PROCON_DEF_TYPE_TRAIT(has_contiguous_data, true,
+(
+    identity<const typename T::value_type*>(p->data()),
+    identity<std::size_t>(p->size())
+));
+
+
+/**
+`data()`で連続したメモリを得られる、符号なし整数型かバイト列比較可能な型のレンジであればtrueになります。
+`std::vector<ImageID>`や`Index2D`が該当します。
+*/
+template <typename T, bool = has_contiguous_data<T>()>
+struct is_trivially_comparable_range : std::false_type {};
+
+
+template <typename T>
+struct is_trivially_comparable_range<T, true>
+: std::integral_constant<bool,
+    is_bytewise_comparable<std::remove_cv_t<typename T::value_type>>::value
+    || std::is_unsigned<typename T::value_type>::value> {};
+
+
 template <typename T>
 int opCmp(const T& v1, const T& v2);
 
@@ -84,6 +396,37 @@ struct DefaultLessCmp {
 };
 
 
+/**
+`IsSimilarToArrayCmp`と同じく、サイズを比較してから要素を辞書順比較します。
+バイト列比較可能な要素は`memcmp`で一度に比較し、
+それ以外の符号なし整数は`std::mismatch`で最初に異なる要素を見つけてから比較します。
+*/
+struct IsTriviallyComparableRangeCmp {
+    template <typename T> static int cmp(const T& v1, const T& v2){
+        auto size_c = DefaultLessCmp::cmp(v1.size(), v2.size());
+        if(size_c) return size_c;
+
+        typedef std::remove_cv_t<typename T::value_type> E;
+        return cmpElements(v1.data(), v2.data(), v1.size(), is_bytewise_comparable<E>());
+    }
+
+  private:
+    template <typename E> static int cmpElements(const E* p1, const E* p2, std::size_t n, std::true_type){
+        static_assert(std::is_trivially_copyable<E>::value, "bytewise comparable type must be trivially copyable");
+        if(n == 0) return 0;
+
+        const int c = std::memcmp(p1, p2, n * sizeof(E));
+        return (c > 0) - (c < 0);
+    }
+
+    template <typename E> static int cmpElements(const E* p1, const E* p2, std::size_t n, std::false_type){
+        const auto m = std::mismatch(p1, p1 + n, p2);
+        if(m.first == p1 + n) return 0;
+        return *m.first < *m.second ? -1 : 1;
+    }
+};
+
+
 /**
 辞書順比較の比較
 */
@@ -94,10 +437,12 @@ int opCmp(const T& v1, const T& v2)
     // 仕方なく、conditionalで分岐するマン
     return std::conditional_t<is_input_iterator<T>(),
         IsInputIteratorCmp,
+        std::conditional_t<is_trivially_comparable_range<T>::value,
+        IsTriviallyComparableRangeCmp,
         std::conditional_t<is_similar_to_array<T>(),
         IsSimilarToArrayCmp,
         DefaultLessCmp
-    >>::cmp(v1, v2);
+    >>>::cmp(v1, v2);
 }
 
 }} // namespace procon::utils
@@ -112,4 +457,13 @@ class hash<procon::utils::Direction> {
         return ::std::hash<size_t>()(static_cast<size_t>(dir));
     }
 };
+
+template<>
+class hash<procon::utils::Position> {
+  public:
+    size_t operator()(procon::utils::Position const & pos) const
+    {
+        return ::std::hash<uint16_t>()(pos.packed());
+    }
+};
 }
@@ -0,0 +1,124 @@
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../../utils/include/image.hpp"
+#include "../../utils/include/dwrite.hpp"
+#include "../../utils/include/exception.hpp"
+#include "../../utils/include/answer.hpp"
+#include "../../utils/include/answer_diff.hpp"
+
+
+using namespace procon::utils;
+
+
+/** コマンドライン引数
+    answer_diff [--threads N] [--list FILE] [--curve] A.txt B.txt [A2.txt B2.txt ...]
+
+    A.txt, B.txt    simulator.cppの入力と同じ形式(1行目が問題画像のパス)の回答
+    --list FILE     比較する回答の組を1行に2つずつ書いたファイル
+    --threads N     比較に使うスレッド数 (デフォルトはハードウェアのスレッド数)
+    --curve         各手数までのコストも出力する
+*/
+struct Options
+{
+    std::vector<std::pair<std::string, std::string>> pairs;
+    size_t threads = std::thread::hardware_concurrency();
+    bool curve = false;
+};
+
+
+Options parseOptions(int argc, char** argv)
+{
+    Options opts;
+    std::vector<std::string> files;
+    for(int i = 1; i < argc; ++i){
+        const std::string arg = argv[i];
+        if(arg == "--threads" && i + 1 < argc)
+            opts.threads = std::stoul(argv[++i]);
+        else if(arg == "--curve")
+            opts.curve = true;
+        else if(arg == "--list" && i + 1 < argc){
+            std::ifstream ifs(argv[++i]);
+            PROCON_ENFORCE(ifs, format("cannot open %", argv[i]));
+
+            std::string a, b;
+            while(ifs >> a >> b)
+                opts.pairs.emplace_back(a, b);
+        }
+        else if(arg.size() > 1 && arg[0] == '-')
+            PROCON_ENFORCE(0, format("unknown option: %", arg));
+        else
+            files.push_back(arg);
+    }
+
+    PROCON_ENFORCE(files.size() % 2 == 0, "answers must be given in pairs");
+    for(size_t i = 0; i < files.size(); i += 2)
+        opts.pairs.emplace_back(files[i], files[i + 1]);
+
+    return opts;
+}
+
+
+/// 問題画像のパスと回答を読み込みます
+std::pair<std::string, Answer> readAnswerFile(std::string const & path)
+{
+    std::ifstream ifs(path);
+    PROCON_ENFORCE(ifs, format("cannot open %", path));
+
+    std::string problem;
+    PROCON_ENFORCE(ifs >> problem, format("cannot read the problem path in %", path));
+    return std::make_pair(problem, readAnswer(ifs));
+}
+
+
+int main(int argc, char** argv)
+{
+    const Options opts = parseOptions(argc, argv);
+
+    // 問題ごとにまとめて並列に比較する
+    std::map<std::string, std::vector<size_t>> byProblem;
+    std::vector<std::pair<Answer, Answer>> answers;
+    for(auto& p: opts.pairs){
+        auto a = readAnswerFile(p.first),
+             b = readAnswerFile(p.second);
+        PROCON_ENFORCE(a.first == b.first, format("% and % are answers of different problems", p.first, p.second));
+
+        byProblem[a.first].push_back(answers.size());
+        answers.emplace_back(std::move(a.second), std::move(b.second));
+    }
+
+    std::vector<AnswerDiff> diffs(answers.size());
+    for(auto& e: byProblem){
+        auto p_opt = Problem::get(e.first);
+        PROCON_ENFORCE(p_opt, format("cannot open %", e.first));
+
+        std::vector<std::pair<Answer, Answer>> group;
+        for(auto k: e.second)
+            group.push_back(answers[k]);
+
+        auto ds = diffAnswers(*p_opt, group, opts.threads);
+        for(auto i: iota(ds.size()))
+            diffs[e.second[i]] = std::move(ds[i]);
+    }
+
+    for(auto i: iota(diffs.size())){
+        auto& d = diffs[i];
+        writefln("% %: %", opts.pairs[i].first, opts.pairs[i].second, d);
+
+        for(auto& t: d.finalDifferences)
+            writeln("    ", t);
+
+        if(opts.curve){
+            for(auto n: iota(std::max(d.stepsA(), d.stepsB()) + 1))
+                writefln("    % % % %", n, d.costA[std::min(n, d.stepsA())], d.costB[std::min(n, d.stepsB())],
+                         "<=>"[d.compareCostAt(n) + 1]);
+        }
+    }
+
+    return 0;
+}
@@ -3,103 +3,96 @@
 #include <vector>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <iomanip>
 #include <opencv2/opencv.hpp>
 #include <opencv/highgui.h>
 
 #include "../../utils/include/image.hpp"
 #include "../../utils/include/dwrite.hpp"
 #include "../../utils/include/exception.hpp"
+#include "../../utils/include/ppm_writer.hpp"
+#include "../../utils/include/answer.hpp"
+#include "../../utils/include/replay.hpp"
 
 
 using namespace procon::utils;
 
 const int timeCoeff = 0;
 
-struct SimulatedImage
+/// 再生中の状態を、選択中の断片を赤くした画像にします
+cv::Mat render(Problem const & pb, ReplayState const & state)
 {
-    SimulatedImage(SwappedImage const & img)
-    : swpImage(img), _sIdx({0, 0})
-    {}
+    cv::Mat dst = SwappedImage(pb.dividedImage(), state.arrangement.get_index()).cvMat();
 
-
-    void select(size_t i, size_t j)
-    {
-        _sIdx[0] = i;
-        _sIdx[1] = j;
-    }
-
-
-    void evaluate(char c)
-    {
-        Index2D aIdx;       // 入れ替えるもう一つの断片のIdx
-        
-        switch(c)
-        {
-            case 'R':
-                PROCON_ENFORCE(_sIdx[1] != swpImage.div_x() - 1, "Simulation Error");
-                aIdx = _sIdx;
-                aIdx[1] += 1;
-                break;
-
-            case 'L':
-                PROCON_ENFORCE(_sIdx[1] != 0, "Simulation Error");
-                aIdx = _sIdx;
-                aIdx[1] -= 1;
-                break;
-
-            case 'U':
-                PROCON_ENFORCE(_sIdx[0] != 0, "Simulation Error");
-                aIdx = _sIdx;
-                aIdx[0] -= 1;
-                break;
-
-            case 'D':
-                PROCON_ENFORCE(_sIdx[0] != swpImage.div_y() - 1, "Simulation Error");
-                aIdx = _sIdx;
-                aIdx[0] += 1;
-                break;
-
-          default:
-            PROCON_ENFORCE(0, format("switch error. %", c));
-        }
-        
-        swpImage.swap_element(_sIdx, aIdx);
-        _sIdx = aIdx;
+    if(state.selected){
+        auto sel = DividedImage(Image(dst), pb.div_x(), pb.div_y()).get_element(state.selected->row(), state.selected->col());
+        sel.cvMat() *= 0.5;
+        sel.cvMat() += cv::Scalar(0, 0, 255) * 0.5;
     }
 
+    return dst;
+}
 
-    cv::Mat cvMat() const
-    {
-        auto dup = swpImage.clone();
 
-        DividedImage::foreach(swpImage, [&](size_t i, size_t j){
-            if(_sIdx[0] == i && _sIdx[1] == j){
-                dup.get_element(i, j).cvMat() *= 0.5;
-                dup.get_element(i, j).cvMat() += cv::Scalar(0, 0, 255) * 0.5;
-            }
-        });
+template <typename T, typename S>
+T readFrom(S& stream)
+{
+    T t;
+    stream >> t;
+    return t;
+}
 
-        return dup.cvMat();
-    }
 
+/** コマンドライン引数
+    --headless      ウィンドウを表示しない
+    --dump DIR      フレームをDIR/frame_000000.ppmのような連番のPPMで書き出す (番号は手数)
+    --every N       Nフレームごとに書き出す (デフォルトは1, 最後のフレームは必ず書き出す)
+    --goto N        最初から再生せず、N手目の状態だけを表示する
+    --interval N    N手ごとに状態を保存する (デフォルトは64)
 
-    SwappedImage swpImage;
-    Index2D _sIdx;      // 現在選択中の座標
+ウィンドウを表示する場合、再生後に次のキーで前後に移動できます。
+    n / p           1手進む / 戻る
+    N / P           保存の間隔だけ進む / 戻る
+    q, ESC          終了
+*/
+struct Options
+{
+    bool headless = false;
+    std::string dumpDir;
+    size_t every = 1;
+    boost::optional<size_t> gotoStep;
+    size_t interval = 64;
 };
 
 
-template <typename T, typename S>
-T readFrom(S& stream)
+Options parseOptions(int argc, char** argv)
 {
-    T t;
-    stream >> t;
-    return t;
+    Options opts;
+    for(int i = 1; i < argc; ++i){
+        const std::string arg = argv[i];
+        if(arg == "--headless")
+            opts.headless = true;
+        else if(arg == "--dump" && i + 1 < argc)
+            opts.dumpDir = argv[++i];
+        else if(arg == "--every" && i + 1 < argc)
+            opts.every = std::max<size_t>(1, std::stoul(argv[++i]));
+        else if(arg == "--goto" && i + 1 < argc)
+            opts.gotoStep = std::stoul(argv[++i]);
+        else if(arg == "--interval" && i + 1 < argc)
+            opts.interval = std::max<size_t>(1, std::stoul(argv[++i]));
+        else
+            PROCON_ENFORCE(0, format("unknown option: %", arg));
+    }
+
+    return opts;
 }
 
 
-int main()
+int main(int argc, char** argv)
 {
     const std::string windowName = "ご注文はシミュレータですか";
+    const Options opts = parseOptions(argc, argv);
 
 
     write("Path(problem image .ppm) ----- ");
@@ -110,41 +103,72 @@ int main()
 
     auto& pb = *p_opt;
 
-    std::vector<std::vector<ImageID>> idxs(pb.div_y());
-    DividedImage::foreach(pb, [&](size_t i, size_t j){
-        if(j == 0) idxs.emplace_back();
-        idxs[i].emplace_back(i, j);
-    });
-
-    auto simImage = SimulatedImage(SwappedImage(pb.dividedImage(), idxs));
-    cv::namedWindow(windowName, CV_WINDOW_AUTOSIZE);
-    cv::imshow(windowName, pb.cvMat());
+    if(!opts.headless){
+        cv::namedWindow(windowName, CV_WINDOW_AUTOSIZE);
+        cv::imshow(windowName, pb.cvMat());
+    }
 
     writeln("----- Please put answer -----");
-
-    size_t selectCNT;
-    std::cin >> selectCNT;
-
-    for(size_t i = 0; i < selectCNT; ++i){
-        size_t idxNum;
-        std::cin >> std::hex >> idxNum;
-        simImage.select(idxNum & 0xF, (idxNum >> 4) & 0xF);
-        cv::imshow(windowName, simImage.cvMat());
-        cv::waitKey(pb.select_cost() * 1000 / 100 * timeCoeff);
-
-        ((void)readFrom<int>(std::cin));
-
-        std::string line;
-        std::cin >> line;
-        for(char c: line){
-            simImage.evaluate(c);
-            cv::imshow(windowName, simImage.cvMat());
-            cv::waitKey(pb.change_cost() * 1000 / 100 * timeCoeff);
+    Replay replay(pb, readAnswer(std::cin), opts.interval);
+
+    auto dump = [&](){
+        if(opts.dumpDir.empty())
+            return;
+
+        const auto& state = replay.state();
+        const auto path = format("%/frame_%.ppm", opts.dumpDir, text(std::setw(6), std::setfill('0'), replay.position()));
+        const SwappedImage img(pb.dividedImage(), state.arrangement.get_index());
+        if(state.selected)
+            writePPM(path, img, *state.selected);
+        else
+            writePPM(path, img);
+    };
+
+    auto show = [&](int waitMs){
+        if(!opts.headless){
+            cv::imshow(windowName, render(pb, replay.state()));
+            return cv::waitKey(waitMs);
         }
+
+        return -1;
+    };
+
+    if(opts.gotoStep){
+        replay.seek(*opts.gotoStep);
+        dump();
+        show(1);
+    }else{
+        do{
+            if(replay.position() % opts.every == 0 || replay.position() == replay.size())
+                dump();
+
+            const bool isSelect = replay.position() != 0 && replay.step(replay.position() - 1).isSelect;
+            show((isSelect ? pb.select_cost() : pb.change_cost()) * 1000 / 100 * timeCoeff);
+        }while(replay.next());
     }
 
-    // キー入力を（無限に）待つ
-    cv::waitKey(0);
+    writeln(format("step %/%, cost %", replay.position(), replay.size(), replay.state().cost));
+
+    // キー入力で前後に移動する
+    while(!opts.headless){
+        const int key = show(0) & 0xFF;
+        const size_t n = replay.position();
+
+        if(key == 'q' || key == 27)
+            break;
+        else if(key == 'n')
+            replay.next();
+        else if(key == 'p')
+            replay.prev();
+        else if(key == 'N')
+            replay.seek(std::min(n + opts.interval, replay.size()));
+        else if(key == 'P')
+            replay.seek(n - std::min(n, opts.interval));
+        else
+            continue;
+
+        writeln(format("step %/%, cost %", replay.position(), replay.size(), replay.state().cost));
+    }
 
     return 0;
 }